@@ -0,0 +1,51 @@
+"""pickle and unpickle throughput for ferns of growing size, in nodes per second"""
+
+from __future__ import print_function
+import fernpy
+import pickle
+from timeit import default_timer
+
+def grown_fern(forks):
+	"""a 2D fern split at random until it has the given number of forks"""
+	fern = fernpy.fern2(fernpy.region2(), 3)
+	fern.set_node_type_chance(1.0) #every mutation splits a leaf
+	fern.set_mutation_type_chance(0.0, 1.0)
+	while fern.get_num_nodes() < 2*forks + 1:
+		fern.mutate()
+	return fern
+
+def timed(function, number):
+	"""seconds taken by number calls of function"""
+	start = default_timer()
+	for _ in range(number):
+		function()
+	return default_timer() - start
+
+def best(function, repeat=5):
+	"""fastest of several runs, each long enough to time, per call"""
+	number = 1
+	elapsed = timed(function, number)
+	while elapsed < 0.2: #python 2's timeit has no autorange
+		number *= 10
+		elapsed = timed(function, number)
+	return min([elapsed] + [timed(function, number) for _ in range(repeat-1)]) / number
+
+#the highest protocol is 2 on python 2 and 5 on recent python 3, so compare like with like
+print("pickle protocol %d" % pickle.HIGHEST_PROTOCOL)
+print("%-8s %10s %12s %12s" % ("forks", "bytes", "dump Mnode/s", "load Mnode/s"))
+for forks in [60, 1000, 10000, 100000]:
+	fern = grown_fern(forks)
+	nodes = fern.get_num_nodes()
+	data = pickle.dumps(fern, pickle.HIGHEST_PROTOCOL)
+	dump = best(lambda: pickle.dumps(fern, pickle.HIGHEST_PROTOCOL))
+	load = best(lambda: pickle.loads(data))
+	print("%-8d %10d %12.2f %12.2f" % (forks, len(data), 1e-6*nodes/dump, 1e-6*nodes/load))
+
+#the pickles the demos saved before the bytes state, read on the slow path
+for name in ["classify_fern.dat", "satellite_fern.dat"]:
+	with open(name, "rb") as saved:
+		data = saved.read()
+	ferns = pickle.loads(data)
+	nodes = sum(fern.get_num_nodes() for fern in ferns)
+	load = best(lambda: pickle.loads(data))
+	print("%-29s %12.2f" % (name, 1e-6*nodes/load))
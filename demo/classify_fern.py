@@ -26,13 +26,9 @@ def generate_data(n=1000):
 ###### fitness evaluation #######
 def fitness(individual, numbers, classes):
 	"""procedure to compute evolutionary fitness"""
-	correct = 0.0
-	p = fernpy.point1()
-	for index, number in enumerate(numbers):
-		p[0] = number
-		if individual.query(p) == classes[index]:
-			correct += 1.0
-	return correct
+	#one call for the whole dataset, through the flattened 1D form
+	bins = fernpy.threshold_fern1(individual).query_array(numbers)
+	return float(numpy.sum(bins == numpy.asarray(classes)))
 	
 def select(population_fitness):
 	"""randomly selects an element based on normalized fitnesses"""
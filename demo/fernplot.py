@@ -8,58 +8,12 @@ blue = (0, 0, 255)
 red = (255, 0, 0)
 green = (0,128,0)
 
-class leaf_iter:
-	node = fp.node_handle1()
-	region = fp.region1()
-	dimensions = 1
-	branch_stack = []
-	
-	def __init__(self, fern):
-		if type(fern) is fp.fern1:
-			self.dimensions = 1
-		elif type(fern) is fp.fern2:
-			self.dimensions = 2
-		else:
-			print "error: only takes node_handles from 1D or 2D ferns"
-			return
-		
-		self.node = fern.begin()
-		self.region = fern.get_region()
-		self.branch_stack = []
-		self.left_most()
-	
-	def left_most(self):
-		while not self.node.is_leaf():
-			self.region.split(self.node.get_fork_division(), 
-					  False)
-			self.branch_stack.append(False)
-			self.node.left()
-	
-	def next(self):
-		restart = False
-		self.node.up()
-		self.region.expand(self.node.get_fork_division(), 
-				   self.branch_stack[-1]) 
-		while self.branch_stack[-1]:
-			self.branch_stack.pop()
-			if len(self.branch_stack) is 0:
-				restart = True
-				break
-			self.node.up()
-			self.region.expand(self.node.get_fork_division(),
-					   self.branch_stack[-1])
-		
-		if not restart:
-			self.branch_stack[-1] = True
-			self.region.split(self.node.get_fork_division(), True)
-			self.node.right()
-		
-		self.left_most()
-		
+def leaves(fern):
+	"""(lower, upper, bin) for every leaf, left to right, from one native call"""
+	lower, upper, bins = fern.leaves()
+	return zip(lower, upper, bins)
 
 def tk_plot(fern):
-	it = leaf_iter(fern)
-	first = leaf_iter(fern)
 	master = tk.Tk()
 	colors = ["blue", "red", "green"]
 	size = 800
@@ -71,15 +25,10 @@ def tk_plot(fern):
 		xmin = fern.get_bounds(1).lower 
 		x = (0, size)
 		
-		while True:
-			xint = it.region[0]
-			x = round((xint.lower-xmin) * scale), \
-			    round((xint.upper-xmin) * scale)
-			canvas.create_rectangle(x[0], 0, x[1], 50, 
-						fill=colors[it.node.get_leaf_bin()])
-			it.next()
-			if it.node == first.node: 
-				break
+		for lower, upper, bin in leaves(fern):
+			x = round((lower[0]-xmin) * scale), \
+			    round((upper[0]-xmin) * scale)
+			canvas.create_rectangle(x[0], 0, x[1], 50, fill=colors[bin])
 		
 	elif type(fern) is fp.fern2:
 		canvas = tk.Canvas(master, width=size, height=size)
@@ -89,18 +38,12 @@ def tk_plot(fern):
 		xmin, ymin = fern.get_bounds(1).lower, fern.get_bounds(2).lower
 		x, y = (0, size), (0, size)
 	
-		while True:
-			xint, yint = it.region[0], it.region[1]
-			x = round((xint.lower-xmin) * scale[0]), \
-			    round((xint.upper-xmin) * scale[0])
-			y = round((yint.lower-ymin) * scale[1]), \
-			    round((yint.upper-ymin) * scale[1])
-			canvas.create_rectangle(x[0], y[0], x[1], y[1],
-						fill=colors[it.node.get_leaf_bin()])
-			#print colors[it.node.get_leaf_bin()]
-			it.next()
-			if it.node == first.node:
-				break
+		for lower, upper, bin in leaves(fern):
+			x = round((lower[0]-xmin) * scale[0]), \
+			    round((upper[0]-xmin) * scale[0])
+			y = round((lower[1]-ymin) * scale[1]), \
+			    round((upper[1]-ymin) * scale[1])
+			canvas.create_rectangle(x[0], y[0], x[1], y[1], fill=colors[bin])
 	else:
 		print "error: only takes 1D or 2D fern inputs"
 		return
@@ -170,8 +113,6 @@ def fernplot_pil_test(dim=1):
 
 def plot(fern, filename="fern.png", numticks=11):
 	"""main plotting function, saves a png file"""
-	it = leaf_iter(fern)
-	first = leaf_iter(fern)
 	colors = [blue, red, green]
 	size = 800
 	image = Image.new("RGB", (size, size), white)
@@ -184,18 +125,13 @@ def plot(fern, filename="fern.png", numticks=11):
 		xmin = fern.get_bounds(1).lower 
 		x = (0, size)
 		
-		while True:
-			xint = it.region[0]
-			x = round((xint.lower-xmin) * scale), \
-			    round((xint.upper-xmin) * scale)
-			draw.rectangle([x[0], 0, x[1], 20], 
-				       colors[it.node.get_leaf_bin()])
+		for lower, upper, bin in leaves(fern):
+			x = round((lower[0]-xmin) * scale), \
+			    round((upper[0]-xmin) * scale)
+			draw.rectangle([x[0], 0, x[1], 20], colors[bin])
 			#draw.line outlines?
 			draw.line([x[0], 0, x[0], 20], black)
 			draw.line([x[1], 0, x[1], 20], black)
-			it.next()
-			if it.node == first.node: 
-				break
 		
 		ticksize = size/(numticks - 1)
 		ticklocs = range(0, 800, ticksize)
@@ -214,22 +150,17 @@ def plot(fern, filename="fern.png", numticks=11):
 		xmin, ymax = fern.get_bounds(1).lower, fern.get_bounds(2).upper
 		x, y = (0, size), (0, size)
 	
-		while True:
-			xint, yint = it.region[0], it.region[1]
-			x = round((xint.lower-xmin) * scale[0]), \
-			    round((xint.upper-xmin) * scale[0])
-			y = round((ymax-yint.upper) * scale[1]), \
-			    round((ymax-yint.lower) * scale[1])
-			draw.rectangle([x[0], y[0], x[1], y[1]],
-				       colors[it.node.get_leaf_bin()])
+		for lower, upper, bin in leaves(fern):
+			x = round((lower[0]-xmin) * scale[0]), \
+			    round((upper[0]-xmin) * scale[0])
+			y = round((ymax-upper[1]) * scale[1]), \
+			    round((ymax-lower[1]) * scale[1])
+			draw.rectangle([x[0], y[0], x[1], y[1]], colors[bin])
 			#draw.line outlines?
 			draw.line([x[0], y[0], x[0], y[1]], black)
 			draw.line([x[1], y[0], x[1], y[1]], black)
 			draw.line([x[0], y[0], x[1], y[0]], black)
 			draw.line([x[0], y[1], x[1], y[1]], black)
-			it.next()
-			if it.node == first.node:
-				break
 	else:
 		print "error: only takes 1D or 2D fern inputs"
 		return
@@ -4,13 +4,8 @@ import numpy
 
 def fitness(individual, numbers, classes):
 	"""procedure to compute evolutionary fitness"""
-	correct = 0.0
-	p = fernpy.point1()
-	for index, number in enumerate(numbers):
-		p[0] = number
-		if individual.query(p) == classes[index]:
-			correct += 1.0
-	return correct
+	bins = individual.query_array(numbers) #one call for the whole dataset
+	return float(numpy.sum(bins == numpy.asarray(classes)))
 
 def run():
 	#prepare ferns
@@ -0,0 +1,139 @@
+#ifndef Accuracy_cpp
+#define Accuracy_cpp
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <algorithm>
+#include <mutex>
+
+namespace clau {
+
+	template<dim_type D, class Visit>
+	void classify_blocks(const CompiledFern<D>& fern, const typename CompiledFern<D>::bases_type& bases,
+			     const std::size_t stride, const std::size_t begin, const std::size_t end,
+			     Visit visit) {
+		//queries [begin, end) a block at a time and calls visit(first, bins, size)
+		const std::size_t block_size = 1024;
+		bin_type bins[block_size];
+		std::array<const num_type*, D> block;
+		for(std::size_t first=begin; first<end; first+=block_size) {
+			std::size_t size = std::min(block_size, end-first);
+			for(int i=0; i<D; ++i) block[i] = bases[i] + first*stride;
+			fern.query_batch(block, stride, size, bins);
+			visit(first, bins, size);
+		}
+	}
+
+	template<dim_type D>
+	double accuracy(const CompiledFern<D>& fern, const typename CompiledFern<D>::bases_type& bases,
+			const std::size_t stride, const std::size_t count,
+			const bin_type* labels, const unsigned int threads) {
+		if(count == 0) return 0.0;
+		std::size_t correct = 0;
+		std::mutex lock;
+		parallel_for(count, threads, 4096, [&](std::size_t begin, std::size_t end) {
+			std::size_t local = 0;
+			classify_blocks(fern, bases, stride, begin, end,
+				[labels, &local](std::size_t first, const bin_type* bins, std::size_t size) {
+					for(std::size_t n=0; n<size; ++n) local += bins[n] == labels[first+n];
+				});
+			std::lock_guard<std::mutex> guard(lock);
+			correct += local;
+		});
+		return double(correct)/count;
+	}
+
+	template<dim_type D>
+	double accuracy(const Fern<D>& fern, const num_type* points, const std::size_t count,
+			const bin_type* labels, const unsigned int threads) {
+		std::array<const num_type*, D> bases;
+		for(int i=0; i<D; ++i) bases[i] = points + i;
+		return accuracy(CompiledFern<D>(fern), bases, D, count, labels, threads);
+	}
+
+	template<dim_type D>
+	double weighted_accuracy(const CompiledFern<D>& fern,
+				 const typename CompiledFern<D>::bases_type& bases,
+				 const std::size_t stride, const std::size_t count,
+				 const bin_type* labels, const num_type* weights,
+				 const unsigned int threads) {
+		double correct = 0.0, total = 0.0;
+		std::mutex lock;
+		parallel_for(count, threads, 4096, [&](std::size_t begin, std::size_t end) {
+			double local_correct = 0.0, local_total = 0.0;
+			classify_blocks(fern, bases, stride, begin, end,
+				[&](std::size_t first, const bin_type* bins, std::size_t size) {
+					for(std::size_t n=0; n<size; ++n) {
+						local_total += weights[first+n];
+						if(bins[n] == labels[first+n]) local_correct += weights[first+n];
+					}
+				});
+			std::lock_guard<std::mutex> guard(lock);
+			correct += local_correct;
+			total += local_total;
+		});
+		return total != 0.0 ? correct/total : 0.0;
+	}
+
+	template<dim_type D>
+	double weighted_accuracy(const Fern<D>& fern, const num_type* points,
+				 const std::size_t count, const bin_type* labels,
+				 const num_type* weights, const unsigned int threads) {
+		std::array<const num_type*, D> bases;
+		for(int i=0; i<D; ++i) bases[i] = points + i;
+		return weighted_accuracy(CompiledFern<D>(fern), bases, D, count,
+					 labels, weights, threads);
+	}
+
+	template<dim_type D>
+	std::vector<std::size_t> confusion_matrix(const CompiledFern<D>& fern,
+						  const typename CompiledFern<D>::bases_type& bases,
+						  const std::size_t stride, const std::size_t count,
+						  const bin_type* labels, const unsigned int threads) {
+		const std::size_t bins = fern.get_num_bins();
+		std::vector<std::size_t> matrix(bins*bins, 0);
+		std::mutex lock;
+		parallel_for(count, threads, 4096, [&](std::size_t begin, std::size_t end) {
+			std::vector<std::size_t> local(bins*bins, 0);
+			classify_blocks(fern, bases, stride, begin, end,
+				[&](std::size_t first, const bin_type* predicted, std::size_t size) {
+					for(std::size_t n=0; n<size; ++n)
+						if(labels[first+n] < bins)
+							++local[labels[first+n]*bins + predicted[n]];
+				});
+			std::lock_guard<std::mutex> guard(lock);
+			for(std::size_t k=0; k<matrix.size(); ++k) matrix[k] += local[k];
+		});
+		return matrix;
+	}
+
+	template<dim_type D>
+	std::vector<std::size_t> confusion_matrix(const Fern<D>& fern, const num_type* points,
+						  const std::size_t count, const bin_type* labels,
+						  const unsigned int threads) {
+		std::array<const num_type*, D> bases;
+		for(int i=0; i<D; ++i) bases[i] = points + i;
+		return confusion_matrix(CompiledFern<D>(fern), bases, D, count, labels, threads);
+	}
+
+} //namespace clau
+
+#endif
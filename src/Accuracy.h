@@ -0,0 +1,79 @@
+#ifndef Accuracy_h
+#define Accuracy_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <array>
+#include <cstddef>
+#include <vector>
+#include "Fern.h"
+#include "CompiledFern.h"
+
+namespace clau {
+
+	/*
+		Scores a Fern as a classifier of labeled points: point n is right
+		when the Fern puts it in bin labels[n]. Points are queried in blocks
+		through CompiledFern's batch kernels and split over threads the same
+		way as query_batch (threads=0 uses every core). The Fern overloads
+		take AoS points and compile a snapshot first; the CompiledFern
+		overloads take the strided layout, coordinate i of point n at
+		bases[i][n*stride], and skip the compile.
+	*/
+
+	//fraction of points classified correctly, 0 for no points
+	template<dim_type D>
+	double accuracy(const CompiledFern<D>& fern, const typename CompiledFern<D>::bases_type& bases,
+			const std::size_t stride, const std::size_t count,
+			const bin_type* labels, const unsigned int threads=1);
+	template<dim_type D>
+	double accuracy(const Fern<D>& fern, const num_type* points, const std::size_t count,
+			const bin_type* labels, const unsigned int threads=1);
+
+	//weight of the points classified correctly over the total weight
+	template<dim_type D>
+	double weighted_accuracy(const CompiledFern<D>& fern,
+				 const typename CompiledFern<D>::bases_type& bases,
+				 const std::size_t stride, const std::size_t count,
+				 const bin_type* labels, const num_type* weights,
+				 const unsigned int threads=1);
+	template<dim_type D>
+	double weighted_accuracy(const Fern<D>& fern, const num_type* points,
+				 const std::size_t count, const bin_type* labels,
+				 const num_type* weights, const unsigned int threads=1);
+
+	//row-major bins x bins counts, matrix[label*bins + predicted];
+	//points labeled past the last bin are left out
+	template<dim_type D>
+	std::vector<std::size_t> confusion_matrix(const CompiledFern<D>& fern,
+						  const typename CompiledFern<D>::bases_type& bases,
+						  const std::size_t stride, const std::size_t count,
+						  const bin_type* labels, const unsigned int threads=1);
+	template<dim_type D>
+	std::vector<std::size_t> confusion_matrix(const Fern<D>& fern, const num_type* points,
+						  const std::size_t count, const bin_type* labels,
+						  const unsigned int threads=1);
+
+} //namespace clau
+
+#include "Accuracy.cpp"
+
+#endif
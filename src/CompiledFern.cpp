@@ -0,0 +1,279 @@
+#ifndef CompiledFern_cpp
+#define CompiledFern_cpp
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+namespace clau {
+
+	inline kernel_type best_kernel() {
+#ifdef CLAU_X86_KERNELS
+		static const kernel_type best = __builtin_cpu_supports("avx2") ? avx2_kernel :
+		                                __builtin_cpu_supports("sse4.1") ? sse4_kernel : 
+		                                scalar_kernel;
+		return best;
+#else
+		return scalar_kernel;
+#endif
+	}
+
+	//=================== CompiledFern methods ======================
+	template<dim_type D>
+	const typename CompiledFern<D>::link_type CompiledFern<D>::leaf_flag;
+
+	template<dim_type D>
+	CompiledFern<D>::CompiledFern() : forks(1), root_region(), max_bin(0) {
+		//same shape as a default Fern: one fork with two leaves in bin 0
+		forks[0].boundary = 0.0;
+		forks[0].coordinate = 0;
+		forks[0].child[0] = forks[0].child[1] = leaf_flag;
+	}
+
+	template<dim_type D>
+	CompiledFern<D>::CompiledFern(const Fern<D>& fern) { compile(fern); }
+
+	template<dim_type D>
+	void CompiledFern<D>::compile(const Fern<D>& fern) {
+		typedef typename Fern<D>::Fork Fork;
+		typedef typename Fern<D>::link_type source_link;
+
+		root_region = fern.root_region;
+		max_bin = fern.max_bin;
+		forks.clear(); //keeps capacity, so recompiling a similar Fern doesn't allocate
+
+		//depth-first, left before right; each entry knows which link to patch
+		std::vector< std::pair<source_link, std::size_t> > stack;
+		stack.push_back( std::make_pair(fern.root, std::size_t(0)) );
+		while( !stack.empty() ) {
+			const Fork& fork = fern.fork_at(stack.back().first);
+			std::size_t patch = stack.back().second;
+			stack.pop_back();
+
+			link_type index = forks.size();
+			if(index != 0) forks[patch/2].child[patch%2] = index;
+
+			Record record;
+			record.boundary = fork.boundary;
+			record.coordinate = fork.value.dimension - 1;
+			forks.push_back(record);
+
+			//push right first so that the left subtree is laid out next
+			const source_link children[2] = {fork.left, fork.right};
+			for(int side=1; side>=0; --side) {
+				if( Fern<D>::is_leaf(children[side]) )
+					forks[index].child[side] = leaf_flag | Fern<D>::bin_of(children[side]);
+				else stack.push_back( std::make_pair(children[side], 2*index+side) );
+			}
+		}
+	}
+
+	template<dim_type D>
+	bin_type CompiledFern<D>::query(const Point<D>& point) const {
+		//same comparison as Fork::query, so NaNs and ties go the same way
+		const Record* records = forks.data();
+		link_type link = 0;
+		do {
+			const Record& fork = records[link];
+			link = fork.child[ !(point(fork.coordinate+1) < fork.boundary) ];
+		} while( !is_leaf(link) );
+		return get_bin(link);
+	}
+
+	template<dim_type D>
+	void CompiledFern<D>::query_batch(const num_type* points, const std::size_t count, 
+					  bin_type* bins, const unsigned int threads) const {
+		std::array<const num_type*, D> bases;
+		for(int i=0; i<D; ++i) bases[i] = points + i;
+		query_batch(bases, D, count, bins, threads);
+	}
+
+	template<dim_type D>
+	void CompiledFern<D>::query_batch(const std::array<const num_type*, D>& columns, 
+					  const std::size_t count, bin_type* bins, 
+					  const unsigned int threads) const {
+		query_batch(columns, 1, count, bins, threads);
+	}
+
+	template<dim_type D>
+	void CompiledFern<D>::query_batch(const std::array<const num_type*, D>& bases, 
+					  const std::size_t stride, const std::size_t count, 
+					  bin_type* bins, const unsigned int threads, 
+					  const kernel_type kernel) const {
+		query_records(forks.data(), bases, stride, count, bins, threads, kernel);
+	}
+
+	template<dim_type D>
+	void CompiledFern<D>::query_records(const Record* records, const bases_type& bases, 
+					    const std::size_t stride, const std::size_t count, 
+					    bin_type* bins, const unsigned int threads, 
+					    const kernel_type kernel) {
+		//coordinate i of point n is bases[i][n*stride]
+		kernel_type chosen = kernel > best_kernel() ? best_kernel() : kernel;
+		if(stride > (1u << 27)) chosen = scalar_kernel; //lane offsets must fit in 32 bits
+		
+		parallel_for(count, threads, 4096, 
+			[records, &bases, stride, bins, chosen](std::size_t begin, std::size_t end) {
+				std::array<const num_type*, D> chunk;
+				for(int i=0; i<D; ++i) chunk[i] = bases[i] + begin*stride;
+				switch(chosen) {
+#ifdef CLAU_X86_KERNELS
+				case avx2_kernel:
+					query_avx2(records, chunk, stride, end-begin, bins+begin);
+					break;
+				case sse4_kernel:
+					query_sse4(records, chunk, stride, end-begin, bins+begin);
+					break;
+#endif
+				default:
+					query_scalar(records, chunk, stride, end-begin, bins+begin);
+				}
+			});
+	}
+
+	template<dim_type D>
+	void CompiledFern<D>::query_scalar(const Record* records, 
+					   const std::array<const num_type*, D>& bases, 
+					   const std::size_t stride, const std::size_t count, 
+					   bin_type* bins) {
+		for(std::size_t n=0; n<count; ++n) {
+			std::size_t offset = n*stride;
+			link_type link = 0;
+			do {
+				const Record& fork = records[link];
+				link = fork.child[ !(bases[fork.coordinate][offset] < fork.boundary) ];
+			} while( !is_leaf(link) );
+			bins[n] = get_bin(link);
+		}
+	}
+
+#ifdef CLAU_X86_KERNELS
+	template<dim_type D>
+	__attribute__((target("sse4.1")))
+	void CompiledFern<D>::query_sse4(const Record* records, 
+					 const std::array<const num_type*, D>& bases, 
+					 const std::size_t stride, const std::size_t count, 
+					 bin_type* bins) {
+		/*
+			Four points descend in lockstep. SSE has no gather, so each lane's
+			fork is loaded by hand, but the comparisons and child selection are
+			done for all lanes at once and the four loads are independent, 
+			which hides most of the latency of a cache miss. 
+		*/
+		alignas(16) std::int32_t links_out[4], left[4], right[4];
+		alignas(16) float boundary[4], x[4];
+		const __m128i no_leaf = _mm_set1_epi32(-1);
+		
+		std::size_t n = 0;
+		for(; n+4 <= count; n+=4) {
+			__m128i links = _mm_setzero_si128(); //every lane starts at the root
+			__m128i active = no_leaf;
+			do {
+				_mm_store_si128(reinterpret_cast<__m128i*>(links_out), links);
+				for(int lane=0; lane<4; ++lane) {
+					//finished lanes harmlessly reread the root
+					const Record& fork = records[ links_out[lane] < 0 ? 0 : links_out[lane] ];
+					boundary[lane] = fork.boundary;
+					x[lane] = bases[fork.coordinate][(n+lane)*stride];
+					left[lane] = fork.child[0];
+					right[lane] = fork.child[1];
+				}
+				//!(x < boundary), true for NaN like the scalar path
+				__m128 go_right = _mm_cmpnlt_ps(_mm_load_ps(x), _mm_load_ps(boundary));
+				__m128i next = _mm_blendv_epi8(
+					_mm_load_si128(reinterpret_cast<const __m128i*>(left)), 
+					_mm_load_si128(reinterpret_cast<const __m128i*>(right)), 
+					_mm_castps_si128(go_right));
+				links = _mm_blendv_epi8(links, next, active);
+				active = _mm_cmpgt_epi32(links, no_leaf); //leaf flag is the sign bit
+			} while( _mm_movemask_epi8(active) );
+			
+			_mm_store_si128(reinterpret_cast<__m128i*>(links_out), links);
+			for(int lane=0; lane<4; ++lane) bins[n+lane] = get_bin(links_out[lane]);
+		}
+		
+		std::array<const num_type*, D> tail;
+		for(int i=0; i<D; ++i) tail[i] = bases[i] + n*stride;
+		query_scalar(records, tail, stride, count-n, bins+n);
+	}
+
+	template<dim_type D>
+	__attribute__((target("avx2")))
+	void CompiledFern<D>::query_avx2(const Record* records, 
+					 const std::array<const num_type*, D>& bases, 
+					 const std::size_t stride, const std::size_t count, 
+					 bin_type* bins) {
+		/*
+			Eight points descend in lockstep, each lane holding its own fork 
+			index. A Record is four 32-bit words, so field f of fork k is word 
+			4k+f and every per-lane load is a single gather. Lanes that reach 
+			a leaf are masked off; the loop ends when all eight have. 
+		*/
+		static_assert(sizeof(Record) == 16, "gather offsets assume 16-byte records");
+		const float* words_ps = reinterpret_cast<const float*>(records);
+		const int* words_epi = reinterpret_cast<const int*>(records);
+		const __m256i lanes = _mm256_mullo_epi32( _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), 
+		                                          _mm256_set1_epi32(static_cast<int>(stride)) );
+		const __m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+		const __m256i no_leaf = _mm256_set1_epi32(-1);
+		alignas(32) std::int32_t links_out[8];
+		
+		std::size_t n = 0;
+		for(; n+8 <= count; n+=8) {
+			__m256i links = _mm256_setzero_si256(); //every lane starts at the root
+			__m256i active = no_leaf;
+			do {
+				__m256i words = _mm256_slli_epi32(links, 2);
+				__m256 boundary = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), words_ps, 
+						words, _mm256_castsi256_ps(active), 4);
+				__m256 x = _mm256_setzero_ps();
+				if(D == 1) {
+					x = _mm256_mask_i32gather_ps(x, bases[0] + n*stride, lanes, 
+							_mm256_castsi256_ps(active), 4);
+				} else {
+					__m256i coordinate = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), 
+							words_epi, _mm256_add_epi32(words, one), active, 4);
+					for(int i=0; i<D; ++i) {
+						__m256i mask = _mm256_and_si256(active, 
+							_mm256_cmpeq_epi32(coordinate, _mm256_set1_epi32(i)));
+						x = _mm256_mask_i32gather_ps(x, bases[i] + n*stride, lanes, 
+								_mm256_castsi256_ps(mask), 4);
+					}
+				}
+				//!(x < boundary), true for NaN like the scalar path
+				__m256i side = _mm256_and_si256(one, 
+					_mm256_castps_si256(_mm256_cmp_ps(x, boundary, _CMP_NLT_UQ)));
+				links = _mm256_mask_i32gather_epi32(links, words_epi, 
+					_mm256_add_epi32(words, _mm256_add_epi32(side, two)), active, 4);
+				active = _mm256_cmpgt_epi32(links, no_leaf); //leaf flag is the sign bit
+			} while( !_mm256_testz_si256(active, active) );
+			
+			_mm256_store_si256(reinterpret_cast<__m256i*>(links_out), links);
+			for(int lane=0; lane<8; ++lane) bins[n+lane] = get_bin(links_out[lane]);
+		}
+		
+		std::array<const num_type*, D> tail;
+		for(int i=0; i<D; ++i) tail[i] = bases[i] + n*stride;
+		query_scalar(records, tail, stride, count-n, bins+n);
+	}
+#endif
+
+} //namespace clau
+
+#endif
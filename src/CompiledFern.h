@@ -0,0 +1,125 @@
+#ifndef CompiledFern_h
+#define CompiledFern_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstdint>
+#include <vector>
+#include "Fern.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CLAU_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace clau {
+
+	//batch query kernels, in order of preference; see best_kernel()
+	enum kernel_type { scalar_kernel, sse4_kernel, avx2_kernel };
+	kernel_type best_kernel();
+
+	template<dim_type D> class MappedFern;
+
+	template<dim_type D>
+	class CompiledFern {
+	/*
+		A CompiledFern is a read-only snapshot of a Fern, laid out for querying.
+		Forks are stored in one contiguous array in depth-first order and refer
+		to their children by index. Leaves are not stored at all: a child link
+		with the leaf flag set holds the leaf's bin directly. Call compile()
+		again after the source Fern changes; it reuses the existing storage.
+	*/
+	public:
+		typedef std::uint32_t link_type;
+		static const link_type leaf_flag = 0x80000000;
+		typedef std::array<const num_type*, D> bases_type; //strided points
+
+		struct Record {
+			num_type boundary;
+			std::uint32_t coordinate; //dimension-1, ready for indexing
+			link_type child[2]; //left, right
+		};
+
+	private:
+		std::vector<Record> forks;
+		Region<D> root_region;
+		bin_type max_bin;
+
+	public:
+		CompiledFern();
+		explicit CompiledFern(const Fern<D>& fern);
+		CompiledFern(const CompiledFern& rhs) = default;
+		CompiledFern& operator=(const CompiledFern& rhs) = default;
+		~CompiledFern() = default;
+
+		void compile(const Fern<D>& fern);
+
+		bin_type query(const Point<D>& point) const;
+		
+		//same layouts as Fern::query_batch
+		void query_batch(const num_type* points, const std::size_t count, 
+		                 bin_type* bins, const unsigned int threads=1) const; //AoS
+		void query_batch(const std::array<const num_type*, D>& columns, 
+		                 const std::size_t count, bin_type* bins, 
+		                 const unsigned int threads=1) const; //SoA
+		void query_batch(const std::array<const num_type*, D>& bases, 
+		                 const std::size_t stride, const std::size_t count, 
+		                 bin_type* bins, const unsigned int threads=1, 
+		                 const kernel_type kernel=best_kernel()) const; //strided
+
+		Region<D> get_region() const { return root_region; }
+		bin_type get_num_bins() const { return max_bin+1; }
+		std::size_t size() const { return forks.size(); }
+		const Record* data() const { return forks.data(); }
+
+		static bool is_leaf(const link_type link) { return link & leaf_flag; }
+		static bin_type get_bin(const link_type link) { return link & ~leaf_flag; }
+		
+	private:
+		template<dim_type T> friend class MappedFern; //shares the layout and kernels
+		
+		static void query_records(const Record* records, const bases_type& bases, 
+		                          const std::size_t stride, const std::size_t count, 
+		                          bin_type* bins, const unsigned int threads, 
+		                          const kernel_type kernel);
+		
+		//each kernel answers count points, the first of which is at bases[i][0]
+		static void query_scalar(const Record* records, 
+		                         const std::array<const num_type*, D>& bases, 
+		                         const std::size_t stride, const std::size_t count, 
+		                         bin_type* bins);
+#ifdef CLAU_X86_KERNELS
+		static void query_sse4(const Record* records, 
+		                       const std::array<const num_type*, D>& bases, 
+		                       const std::size_t stride, const std::size_t count, 
+		                       bin_type* bins);
+		static void query_avx2(const Record* records, 
+		                       const std::array<const num_type*, D>& bases, 
+		                       const std::size_t stride, const std::size_t count, 
+		                       bin_type* bins);
+#endif
+	}; //class CompiledFern
+
+} //namespace clau
+
+#include "CompiledFern.cpp"
+
+#endif
@@ -21,20 +21,112 @@
     e-mail: jackwhall7@gmail.com
 */
 
+#include <algorithm>
+#include <cstring>
+
 namespace clau {
 
+	//little-endian fields and bit packing for Fern's binary format
+	struct byte_writer {
+		std::string& out;
+		explicit byte_writer(std::string& buffer) : out(buffer) {}
+		void put(std::uint32_t value, const int bytes) {
+			for(int i=0; i<bytes; ++i, value >>= 8) out.push_back( char(value & 0xFF) );
+		}
+		void put_float(const float value) {
+			std::uint32_t word;
+			std::memcpy(&word, &value, 4);
+			put(word, 4);
+		}
+	};
+	
+	struct byte_reader {
+		const unsigned char* data;
+		std::size_t size, position;
+		byte_reader(const char* cData, const std::size_t cSize) 
+			: data(reinterpret_cast<const unsigned char*>(cData)), size(cSize), position(0) {}
+		bool get(std::uint32_t& value, const int bytes) {
+			if(size - position < std::size_t(bytes)) return false;
+			value = 0;
+			for(int i=0; i<bytes; ++i) value |= std::uint32_t(data[position++]) << 8*i;
+			return true;
+		}
+		bool get_float(float& value) {
+			std::uint32_t word;
+			if( !get(word, 4) ) return false;
+			std::memcpy(&value, &word, 4);
+			return true;
+		}
+	};
+	
+	struct bit_writer { //low bits first
+		std::string& out;
+		std::uint64_t pending;
+		int count;
+		explicit bit_writer(std::string& buffer) : out(buffer), pending(0), count(0) {}
+		void put(const std::uint32_t value, const int bits) { //bits <= 32
+			pending |= std::uint64_t(value) << count;
+			count += bits;
+			if(count >= 32) {
+				char bytes[4] = {char(pending), char(pending >> 8), 
+						 char(pending >> 16), char(pending >> 24)};
+				out.append(bytes, 4);
+				pending >>= 32;
+				count -= 32;
+			}
+		}
+		void flush() { for(; count > 0; count -= 8, pending >>= 8) out.push_back( char(pending) ); }
+	};
+	
+	struct bit_reader {
+		const unsigned char* data;
+		std::size_t size, position;
+		std::uint64_t pending;
+		int count;
+		bit_reader(const char* cData, const std::size_t cSize) 
+			: data(reinterpret_cast<const unsigned char*>(cData)), size(cSize), 
+			  position(0), pending(0), count(0) {}
+		bool get(std::uint32_t& value, const int bits) {
+			while(count < bits) {
+				if(position == size) return false;
+				pending |= std::uint64_t(data[position++]) << count;
+				count += 8;
+			}
+			value = pending & ((std::uint64_t(1) << bits) - 1);
+			pending >>= bits;
+			count -= bits;
+			return true;
+		}
+	};
+	
+	inline int bits_for(std::uint32_t largest) { //to hold 0..largest
+		int bits = 0;
+		for(; largest > 0; largest >>= 1) ++bits;
+		return bits;
+	}
+
 	//=================== Fern methods ======================
+	template<dim_type D>
+	const typename Fern<D>::link_type Fern<D>::leaf_flag;
+	
+	template<dim_type D>
+	const typename Fern<D>::link_type Fern<D>::no_link;
+	
+	template<dim_type D>
+	const std::size_t Fern<D>::grid_bytes;
+	
 	template<dim_type D>
 	Fern<D>::Fern() : Fern(1) {}
 	
 	template<dim_type D>
-	Fern<D>::Fern(const bin_type numBins) : root_region(), max_bin(numBins-1),
+	Fern<D>::Fern(const bin_type numBins) : forks(std::make_shared<fork_pool>()), 
+						root_region(), max_bin(numBins-1),
 						node_type_chance(0.6),
 						mutation_type_chance_leaf(0.25), 
 						mutation_type_chance_fork(0.15) {
 		
 		Division<D> root_division = {false, 1};
-		root = new Fork(nullptr, root_division, 0, 0);
+		root = new_fork(root_division, 0, 0);
 		
 		std::random_device device;
 		generator.seed( device() );
@@ -42,13 +134,14 @@ namespace clau {
 	
 	template<dim_type D>
 	Fern<D>::Fern(const Region<D> bounds, const bin_type numBins) 
-		: root_region(bounds), max_bin(numBins-1), node_type_chance(0.6),
+		: forks(std::make_shared<fork_pool>()), 
+		  root_region(bounds), max_bin(numBins-1), node_type_chance(0.6),
 		  mutation_type_chance_leaf(0.25), mutation_type_chance_fork(0.15) {
 		
 		Division<D> root_division = {false, 1};
-		root = new Fork(nullptr, root_division, 0, 0);
+		root = new_fork(root_division, 0, 0);
 		
-		root->update_boundary(root_region);
+		update_boundary();
 		
 		std::random_device device;
 		generator.seed( device() );
@@ -56,15 +149,31 @@ namespace clau {
 	
 	template<dim_type D>
 	Fern<D>::Fern(const Fern<D>& rhs) 
-		: root( new Fork(*rhs.root) ), root_region(rhs.root_region), 
+		: forks(rhs.forks), root(rhs.root), //shares the whole tree
+		  root_region(rhs.root_region), 
 		  max_bin(rhs.max_bin), node_type_chance(rhs.node_type_chance),
 		  mutation_type_chance_leaf(rhs.mutation_type_chance_leaf),
-		  mutation_type_chance_fork(rhs.mutation_type_chance_fork) {
-		  
+		  mutation_type_chance_fork(rhs.mutation_type_chance_fork), 
+		  grid(copy_grid(rhs.grid)) {
+		
+		share(root);
 		std::random_device device;
 		generator.seed( device() );
 	}
 	
+	template<dim_type D>
+	Fern<D>::Fern(Fern<D>&& rhs) noexcept
+		: forks(std::move(rhs.forks)), root(rhs.root), 
+		  root_region(rhs.root_region), max_bin(rhs.max_bin), 
+		  generator(rhs.generator), //no reseeding
+		  node_type_chance(rhs.node_type_chance),
+		  mutation_type_chance_leaf(rhs.mutation_type_chance_leaf),
+		  mutation_type_chance_fork(rhs.mutation_type_chance_fork), 
+		  grid(std::move(rhs.grid)) { //still fits the tree it came with
+		
+		rhs.root = no_link;
+	}
+	
 	template<dim_type D>
 	Fern<D>& Fern<D>::operator=(const Fern<D>& rhs) { 
 		if(this != &rhs) {
@@ -73,15 +182,123 @@ namespace clau {
 			node_type_chance = rhs.node_type_chance;
 			mutation_type_chance_leaf = rhs.mutation_type_chance_leaf;
 			mutation_type_chance_fork = rhs.mutation_type_chance_fork;
-			delete root;
-			root = new Fork(*rhs.root);
+			grid = copy_grid(rhs.grid);
+			
+			//take the new tree before letting go of the old one, which may be it
+			std::shared_ptr<fork_pool> old_forks = forks;
+			link_type old_root = root;
+			forks = rhs.forks;
+			root = share(rhs.root);
+			if(old_forks) release(*old_forks, old_root); //none if moved from
 		}
 		return *this;
 	}
 	
 	template<dim_type D>
-	Fern<D>::~Fern() {
-		delete root;
+	Fern<D>& Fern<D>::operator=(Fern<D>&& rhs) noexcept { 
+		swap(rhs); //rhs releases the old tree whenever it goes
+		return *this;
+	}
+	
+	template<dim_type D>
+	Fern<D>::~Fern() { if(forks) release(root); } //the pool goes with its last Fern
+	
+	template<dim_type D>
+	void Fern<D>::swap(Fern<D>& other) noexcept {
+		using std::swap;
+		swap(forks, other.forks);
+		swap(root, other.root);
+		swap(root_region, other.root_region);
+		swap(max_bin, other.max_bin);
+		swap(generator, other.generator);
+		swap(node_type_chance, other.node_type_chance);
+		swap(mutation_type_chance_leaf, other.mutation_type_chance_leaf);
+		swap(mutation_type_chance_fork, other.mutation_type_chance_fork);
+		swap(grid, other.grid);
+	}
+	
+	template<dim_type D>
+	typename Fern<D>::link_type Fern<D>::new_fork(const Division<D> value, 
+						       const bin_type left_bin, 
+						       const bin_type right_bin) {
+		//does not set boundary! This should be done by node_handle from the root node
+		link_type fork = forks->create(value);
+		Fork& created = fork_at(fork);
+		created.left = leaf_link(left_bin);
+		created.right = leaf_link(right_bin);
+		created.size = 3;
+		return fork;
+	}
+	
+	template<dim_type D>
+	typename Fern<D>::link_type Fern<D>::clone(const fork_pool& source, 
+						    const link_type node) {
+		//copies a subtree from another pool into this Fern's pool, allocating 
+		//in depth-first order so the copy is laid out for traversal
+		if( is_leaf(node) ) return node;
+		
+		struct Pending { link_type source, parent; bool right; };
+		std::vector<Pending> stack;
+		stack.push_back( Pending{node, no_link, false} );
+		link_type copy_root = no_link;
+		while( !stack.empty() ) {
+			Pending next = stack.back();
+			stack.pop_back();
+			
+			//read by value: creating nodes may move the pool
+			Fork fork = source[next.source];
+			fork.owners = 1;
+			link_type copy = forks->create(fork);
+			if( !is_leaf(fork.right) ) stack.push_back( Pending{fork.right, copy, true} );
+			if( !is_leaf(fork.left) ) stack.push_back( Pending{fork.left, copy, false} );
+			
+			if(copy_root == no_link) copy_root = copy;
+			else if(next.right) fork_at(next.parent).right = copy;
+			else fork_at(next.parent).left = copy;
+		}
+		return copy_root;
+	}
+	
+	template<dim_type D>
+	typename Fern<D>::link_type Fern<D>::unshare(const link_type fork) {
+		//the copy takes over this Fern's claim, and shares both children
+		if(fork_at(fork).owners == 1) return fork;
+		Fork copy = fork_at(fork);
+		--fork_at(fork).owners;
+		copy.owners = 1;
+		share(copy.left);
+		share(copy.right);
+		return forks->create(copy);
+	}
+	
+	template<dim_type D>
+	void Fern<D>::release(fork_pool& pool, const link_type node) {
+		//drops one claim on a subtree, freeing the Forks nobody else owns
+		std::vector<link_type> stack(1, node);
+		while( !stack.empty() ) {
+			link_type next = stack.back();
+			stack.pop_back();
+			if( is_leaf(next) ) continue;
+			Fork& fork = pool[next];
+			if(--fork.owners == 0) {
+				stack.push_back(fork.left);
+				stack.push_back(fork.right);
+				pool.destroy(next);
+			}
+		}
+	}
+	
+	template<dim_type D>
+	void Fern<D>::compact() {
+		//copies this Fern's tree into a new pool without holes, leaving any 
+		//Ferns it shared with in the old one; invalidates node_handles
+		std::shared_ptr<fork_pool> old_forks = forks;
+		forks = std::make_shared<fork_pool>();
+		forks->reserve( (*old_forks)[root].size/2 );
+		link_type old_root = root;
+		root = clone(*old_forks, old_root);
+		release(*old_forks, old_root);
+		invalidate_grid();
 	}
 	
 	template<dim_type D>
@@ -107,14 +324,32 @@ namespace clau {
 	template<dim_type D>
 	void Fern<D>::set_bounds(const Region<D> bounds) { 
 		root_region = bounds;
-		root->update_boundary(bounds);
+		update_boundary();
+	}
+	
+	template<dim_type D>
+	bool Fern<D>::set_grid(const unsigned int resolution, const std::size_t max_bytes) {
+		//returns false for D > 3, where a grid fine enough to help is too big
+		if(D > 3) return false;
+		if(resolution == 0) {
+			grid.reset();
+			return true;
+		}
+		auto fits = [max_bytes](const double cells) { 
+			return std::pow(cells, D)*sizeof(link_type) <= max_bytes; };
+		double largest = std::floor( std::pow(double(max_bytes)/sizeof(link_type), 1.0/D) );
+		while( largest > 0 && !fits(largest) ) --largest; //pow may round up
+		while( fits(largest+1) ) ++largest; //or down
+		unsigned int cells = std::min<double>(resolution, largest);
+		grid.reset( new Grid(cells, max_bytes) );
+		return true;
 	}
 	
 	template<dim_type D>
 	void Fern<D>::randomize(const unsigned int mutations) {
 		auto locus = begin();
 		for(int i=mutations; i>0; i--) {
-			while( !locus.is_leaf() ) locus.random();
+			if( !locus.is_leaf() ) locus.random_leaf();
 			std::bernoulli_distribution mutation_type_gen(mutation_type_chance_leaf);
 			if( mutation_type_gen(generator) ) { //if mutation is structural
 				if( !locus.mutate_structure() ) locus.mutate_value();
@@ -127,12 +362,8 @@ namespace clau {
 		auto locus = begin();
 		std::bernoulli_distribution  node_type_gen(node_type_chance);
 		bool node_type = node_type_gen(generator);
-		if( node_type ) { //if locus is a leaf
-			while( !locus.is_leaf() ) locus.random();
-		} else { 
-			do locus.random(); 
-			while( locus.is_leaf() );
-		}
+		if( node_type ) locus.random_leaf(); //if locus is a leaf
+		else locus.random_fork();
 		
 		std::bernoulli_distribution  mutation_type_gen( node_type ? 
 								mutation_type_chance_leaf :
@@ -144,10 +375,120 @@ namespace clau {
 	
 	template<dim_type D>
 	void Fern<D>::crossover(const Fern& other) { 
+		crossover( other, pairing(*this, other) );
+	}
+	
+	template<dim_type D>
+	void Fern<D>::crossover(const Fern& other, const pairing& shared) { 
 		auto target = begin(); 
 		auto source = const_cast<Fern&>(other).begin(); 
-		target.random_analagous(source); 
-		target.splice(source);
+		if( shared.random(target, source) ) target.splice(source);
+	}
+	
+	template<dim_type D>
+	bin_type Fern<D>::query(const Point<D> point) const {
+		link_type node = start(ready_grid(), point);
+		return is_leaf(node) ? bin_of(node) : query_node(node, point);
+	}
+	
+	template<dim_type D>
+	void Fern<D>::query_batch(const num_type* points, const std::size_t count, 
+				  bin_type* bins, const unsigned int threads) const {
+		std::array<const num_type*, D> bases;
+		for(int i=0; i<D; ++i) bases[i] = points + i;
+		query_batch(bases, D, count, bins, threads);
+	}
+	
+	template<dim_type D>
+	void Fern<D>::query_batch(const std::array<const num_type*, D>& columns, 
+				  const std::size_t count, bin_type* bins, 
+				  const unsigned int threads) const {
+		query_batch(columns, 1, count, bins, threads);
+	}
+	
+	template<dim_type D>
+	void Fern<D>::query_batch(const std::array<const num_type*, D>& bases, 
+				  const std::size_t stride, const std::size_t count, 
+				  bin_type* bins, const unsigned int threads) const {
+		//coordinate i of point n is bases[i][n*stride]
+		const Grid* cells = ready_grid();
+		parallel_for(count, threads, 4096, 
+			[this, &bases, stride, bins, cells](std::size_t begin, std::size_t end) {
+				Point<D> point;
+				for(std::size_t n=begin; n<end; ++n) {
+					for(int i=0; i<D; ++i) point(i+1) = bases[i][n*stride];
+					link_type node = start(cells, point);
+					bins[n] = is_leaf(node) ? bin_of(node) : query_node(node, point);
+				}
+			});
+	}
+	
+	template<dim_type D>
+	void Fern<D>::rasterize(const Region<D>& window, const std::size_t width, 
+				const std::size_t height, bin_type* image, 
+				const unsigned int threads) const {
+		/*
+			Pixel (x, y) is query() at its center: dimension 1 runs along 
+			rows, dimension 2 down columns. Further dimensions are held at 
+			window's lower bounds, a slice; a 1D Fern repeats its one row. 
+			Tiles are split over threads, and each walks down only the 
+			forks that cut it, splitting its pixel ranges at the boundaries 
+			and filling whole leaf rectangles at once.
+		*/
+		if(width == 0 || height == 0) return;
+		auto center = [&window](const dim_type dimension, const std::size_t index, 
+					 const std::size_t pixels) -> num_type {
+			const Interval& interval = window(dimension);
+			return interval.lower + (index + 0.5)*(double(interval.upper) - interval.lower)/pixels;
+		};
+		
+		const std::size_t tile = 256;
+		const std::size_t columns = (width + tile - 1)/tile, rows = (height + tile - 1)/tile;
+		parallel_for(columns*rows, threads, 1, [&](std::size_t begin, std::size_t end) {
+			struct Block { link_type node; std::size_t x0, x1, y0, y1; };
+			std::vector<Block> stack;
+			for(std::size_t t=begin; t<end; ++t) {
+				std::size_t x = (t % columns)*tile, y = (t / columns)*tile;
+				stack.push_back( Block{root, x, std::min(x+tile, width), 
+						       y, std::min(y+tile, height)} );
+				while( !stack.empty() ) {
+					Block block = stack.back();
+					stack.pop_back();
+					if( is_leaf(block.node) ) {
+						for(std::size_t row=block.y0; row<block.y1; ++row) 
+							std::fill(image + row*width + block.x0, image + row*width + block.x1, 
+								  bin_of(block.node));
+						continue;
+					}
+					
+					const Fork& fork = fork_at(block.node);
+					const dim_type dimension = fork.value.dimension;
+					if(dimension > 2 || (D == 1 && dimension == 2)) {
+						bool below = window(dimension).lower < fork.boundary;
+						block.node = below ? fork.left : fork.right;
+						stack.push_back(block);
+						continue;
+					}
+					//first pixel whose center isn't left of the boundary, as query() decides
+					std::size_t& first = dimension == 1 ? block.x0 : block.y0;
+					std::size_t& last = dimension == 1 ? block.x1 : block.y1;
+					const std::size_t pixels = dimension == 1 ? width : height;
+					std::size_t low = first, high = last;
+					while(low < high) {
+						std::size_t middle = low + (high - low)/2;
+						if(center(dimension, middle, pixels) < fork.boundary) low = middle + 1;
+						else high = middle;
+					}
+					Block left = block, right = block;
+					left.node = fork.left;
+					(dimension == 1 ? left.x1 : left.y1) = low;
+					right.node = fork.right;
+					(dimension == 1 ? right.x0 : right.y0) = low;
+					if(low < last) stack.push_back(right);
+					if(first < low) stack.push_back(left);
+				}
+			}
+		});
 	}
 	
 	template<dim_type T>
@@ -160,184 +501,553 @@ namespace clau {
 			out << "\t[" << fern.root_region(i).lower << ", " << fern.root_region(i).upper << "]" << endl; 
 		out << "Number of bins: " << fern.max_bin+1 << endl;
 		out << "Fern structure:" << endl;
-		fern.root->print(out, 0);
+		fern.print(out, fern.root, 0);
 		
 		return out;
 	}
 	
-	//==================== Fern::Fork methods ===================
-	template<dim_type D>
-	Fern<D>::Fork::Fork(Fork* pParent, const Division<D> cValue, 
-			    const bin_type left_bin, const bin_type right_bin) 
-		: Node(pParent, false), value(cValue) {
-		//does not set boundary! This should be done by node_handle from the root node
-		left  = new Leaf(this, left_bin);
-		right = new Leaf(this, right_bin);
-	}
-	
+	//==================== Fern binary format ===================
+	/*
+		All fields are little-endian:
+		    "FERN", uint16 version, uint16 D, 
+		    D x (float32 lower, float32 upper), uint16 max_bin, 
+		    float32 node_type_chance, mutation_type_chance_fork, 
+		    mutation_type_chance_leaf, uint32 nodes, uint32 payload bytes, 
+		    payload
+		The payload lists the nodes in preorder, packed low bits first: a 
+		leaf is a 1 bit then its bin in just enough bits for max_bin, and a 
+		fork is a 0 bit, its Division's bit, then dimension-1 in just 
+		enough bits for D-1. Boundaries are recomputed on loading. 
+	*/
 	template<dim_type D>
-	Fern<D>::Fork::Fork(Fork* pParent, const Division<D> cValue) 
-		: Node(pParent, false), value(cValue), left(nullptr), right(nullptr) {}
+	const std::uint16_t Fern<D>::binary_version;
 	
 	template<dim_type D>
-	Fern<D>::Fork::Fork(const Fork& rhs) 
-		: Node(rhs.parent, false), value(rhs.value), boundary(rhs.boundary) {
-		//copy left subtree
-		if( rhs.left->leaf ) left = new Leaf( *static_cast<Leaf*>(rhs.left) );
-		else 		     left = new Fork( *static_cast<Fork*>(rhs.left) );
-		left->parent = this;
+	std::string Fern<D>::save_binary() const {
+		std::string data;
+		data.reserve(36 + 8*D + fork_at(root).size/2);
+		byte_writer header(data);
+		data.append("FERN", 4);
+		header.put(binary_version, 2);
+		header.put(D, 2);
+		for(int i=1; i<=D; ++i) {
+			header.put_float(root_region(i).lower);
+			header.put_float(root_region(i).upper);
+		}
+		header.put(max_bin, 2);
+		header.put_float(node_type_chance);
+		header.put_float(mutation_type_chance_fork);
+		header.put_float(mutation_type_chance_leaf);
+		header.put(fork_at(root).size, 4);
+		const std::size_t payload_size = data.size();
+		header.put(0, 4); //patched below
+		
+		const int bin_bits = bits_for(max_bin), dimension_bits = bits_for(D-1);
+		bit_writer payload(data);
+		std::vector<link_type> stack(1, root);
+		while( !stack.empty() ) {
+			link_type node = stack.back();
+			stack.pop_back();
+			if( is_leaf(node) ) {
+				payload.put(1, 1);
+				payload.put(bin_of(node), bin_bits);
+			} else {
+				const Fork& fork = fork_at(node);
+				payload.put(0, 1);
+				payload.put(fork.value.bit, 1);
+				payload.put(fork.value.dimension-1, dimension_bits);
+				stack.push_back(fork.right);
+				stack.push_back(fork.left);
+			}
+		}
+		payload.flush();
 		
-		//copy right subtree
-		if( rhs.right->leaf ) right = new Leaf( *static_cast<Leaf*>(rhs.right) );
-		else 		      right = new Fork( *static_cast<Fork*>(rhs.right) );
-		right->parent = this;
+		std::uint32_t bytes = data.size() - payload_size - 4;
+		for(int i=0; i<4; ++i) data[payload_size+i] = char(bytes >> 8*i);
+		return data;
 	}
 	
 	template<dim_type D>
-	typename Fern<D>::Fork&  Fern<D>::Fork::operator=(const Fork& rhs) {
+	void Fern<D>::save_binary(std::ostream& out) const {
+		std::string data = save_binary();
+		out.write(data.data(), data.size());
+	}
 	
-		if( this != &rhs ) {
-			//keeps its place in its original tree (does not copy parent pointer)
-			value = rhs.value;
-			boundary = rhs.boundary; //assumes identical context, may need to update after copy
+	template<dim_type D>
+	bool Fern<D>::load_binary(std::istream& in) {
+		//reads exactly one saved Fern, so several can follow each other
+		const std::size_t header_size = 30 + 8*D;
+		std::string data(header_size, '\0');
+		if( !in.read(&data[0], header_size) ) return false;
+		byte_reader header(data.data() + header_size - 8, 8);
+		std::uint32_t nodes, bytes;
+		header.get(nodes, 4);
+		header.get(bytes, 4);
 		
-			//replace left subtree
-			delete left;
-			left = nullptr;
+		//no node takes more than 18 bits, and the payload is read a chunk at 
+		//a time, so a bad length fails at the end of the stream instead of 
+		//allocating all it claims up front
+		if( bytes > (std::uint64_t(nodes)*18 + 7)/8 ) return false;
+		const std::size_t chunk = 1 << 16;
+		for(std::size_t done=0; done<bytes; ) {
+			std::size_t part = std::min<std::size_t>(chunk, bytes - done);
+			data.resize(header_size + done + part);
+			if( !in.read(&data[header_size + done], part) ) return false;
+			done += part;
+		}
+		return load_binary(data.data(), data.size());
+	}
 	
-			if( rhs.left->leaf ) left = new Leaf( *static_cast<Leaf*>(rhs.left) );
-			else 		     left = new Fork( *static_cast<Fork*>(rhs.left) );
-			left->parent = this;
+	template<dim_type D>
+	bool Fern<D>::load_binary(const char* data, const std::size_t size) {
+		byte_reader header(data, size);
+		if( size < 4 || std::memcmp(data, "FERN", 4) != 0 ) return false;
+		header.position = 4;
+		std::uint32_t version, dimensions, bins, nodes, bytes;
+		if( !header.get(version, 2) || version != binary_version ) return false;
+		if( !header.get(dimensions, 2) || dimensions != D ) return false;
+		Region<D> region;
+		for(int i=1; i<=D; ++i) 
+			if( !header.get_float(region(i).lower) || !header.get_float(region(i).upper) ) 
+				return false;
+		float chances[3];
+		if( !header.get(bins, 2) ) return false;
+		for(float& chance : chances) if( !header.get_float(chance) ) return false;
+		if( !header.get(nodes, 4) || !header.get(bytes, 4) ) return false;
+		if( size - header.position < bytes || nodes < 3 || nodes > 8.0*bytes ) return false;
 		
-			//replace right subtree
-			delete right;
-			right = nullptr;
+		//rebuild in a pool of its own, so a bad payload changes nothing
+		auto pool = std::make_shared<fork_pool>();
+		pool->reserve(nodes/2);
+		const int bin_bits = bits_for(bins), dimension_bits = bits_for(D-1);
+		bit_reader payload(data + header.position, bytes);
+		std::vector< std::pair<link_type, int> > open; //forks and their children so far
+		link_type new_root = no_link;
+		for(std::uint32_t n=0; n<nodes; ++n) {
+			std::uint32_t leaf, field;
+			if( !payload.get(leaf, 1) ) return false;
+			link_type node;
+			if(leaf) {
+				if( !payload.get(field, bin_bits) || field > bins ) return false;
+				node = leaf_link(field);
+			} else {
+				std::uint32_t bit;
+				if( !payload.get(bit, 1) || !payload.get(field, dimension_bits) || 
+				    field >= D ) return false;
+				node = pool->create( Division<D>(bit, field+1) );
+			}
+			
+			if( open.empty() ) { //only the root comes with nothing open
+				if(new_root != no_link || leaf) return false;
+				new_root = node;
+			} else {
+				Fork& parent = (*pool)[open.back().first];
+				(open.back().second++ == 0 ? parent.left : parent.right) = node;
+			}
+			if(!leaf) open.push_back( std::make_pair(node, 0) );
+			while( !open.empty() && open.back().second == 2 ) {
+				Fork& fork = (*pool)[open.back().first];
+				fork.size = 1;
+				for(link_type child : {fork.left, fork.right}) 
+					fork.size += is_leaf(child) ? 1 : (*pool)[child].size;
+				open.pop_back();
+			}
+		}
+		if( !open.empty() ) return false;
 		
-			if( rhs.right->leaf ) right = new Leaf( *static_cast<Leaf*>(rhs.right) );
-			else 		      right = new Fork( *static_cast<Fork*>(rhs.right) );
-			right->parent = this;
+		if(forks) release(root);
+		forks = pool;
+		root = new_root;
+		root_region = region;
+		max_bin = bins;
+		node_type_chance = chances[0];
+		mutation_type_chance_fork = chances[1];
+		mutation_type_chance_leaf = chances[2];
+		update_boundary();
+		return true;
+	}
+	
+	//==================== Fern node methods ===================
+	template<dim_type D>
+	void Fern<D>::print(std::ostream& out, const link_type node, unsigned int depth) const {
+		//preorder with an explicit stack, so deep trees can't overflow the call stack
+		using namespace std;
+		std::vector< std::pair<link_type, unsigned int> > stack(1, std::make_pair(node, depth));
+		while( !stack.empty() ) {
+			link_type next = stack.back().first;
+			unsigned int level = stack.back().second;
+			stack.pop_back();
+			for(int i=level; i>0; --i) out << "    ";
+			if( is_leaf(next) ) {
+				out << "{B" << bin_of(next) << "}" << endl;
+			} else {
+				const Fork& fork = fork_at(next);
+				out << "{" << fork.value.bit << ", D" << fork.value.dimension << "}" << endl;
+				stack.push_back( std::make_pair(fork.right, level+1) );
+				stack.push_back( std::make_pair(fork.left, level+1) );
+			}
 		}
-		return *this;
 	}
 	
 	template<dim_type D>
-	Fern<D>::Fork::~Fork() noexcept {
-		delete left;
-		left = nullptr;
-
-		delete right;
-		right = nullptr;
+	bin_type Fern<D>::query_node(link_type node, const Point<D>& point) const {
+		do {
+			const Fork& fork = fork_at(node);
+			node = point(fork.value.dimension) < fork.boundary ? fork.left : fork.right;
+		} while( !is_leaf(node) );
+		return bin_of(node);
 	}
 	
 	template<dim_type D>
-	void Fern<D>::Fork::print(std::ostream& out, unsigned int depth) const {
-		using namespace std;
-		for(int i=depth; i>0; --i) out << "    ";
-		out << "{" << value.bit << ", D" << value.dimension << "}" << endl;
-		left->print(out, depth+1);
-		right->print(out, depth+1);
+	std::unique_ptr<typename Fern<D>::Grid> 
+	Fern<D>::copy_grid(const std::unique_ptr<Grid>& source) {
+		//the settings only; the copy builds its own cells when first queried
+		if(!source) return std::unique_ptr<Grid>();
+		return std::unique_ptr<Grid>( new Grid(source->cells, source->max_bytes) );
 	}
 	
 	template<dim_type D>
-	bin_type Fern<D>::Fork::query(const Point<D> point) const {
-		if(point(value.dimension) < boundary) {
-			if(left->leaf) return static_cast<Leaf*>(left)->query();
-			else return static_cast<Fork*>(left)->query(point);
-		} else {
-			if(right->leaf) return static_cast<Leaf*>(right)->query();
-			else return static_cast<Fork*>(right)->query(point);
+	const typename Fern<D>::Grid* Fern<D>::ready_grid() const {
+		if(!grid) return nullptr;
+		if( !grid->ready.load(std::memory_order_acquire) ) {
+			std::lock_guard<std::mutex> guard(grid->building);
+			if( !grid->ready.load(std::memory_order_relaxed) ) {
+				build_grid(*grid);
+				grid->ready.store(true, std::memory_order_release);
+			}
 		}
+		return grid->links.empty() ? nullptr : grid.get();
 	}
 	
 	template<dim_type D>
-	void Fern<D>::Fork::update_boundary(const Region<D> bounds) {
-		num_type ratio = 2.0/(1.0 + sqrt(5));
-		Interval interval = bounds(value.dimension);
+	void Fern<D>::build_grid(Grid& cells) const {
+		/*
+			Splits blocks of cells down the tree as rasterize does pixels. 
+			A cell goes to a child only if its edges, widened by the slack, 
+			are all on that child's side of the boundary; the cells a 
+			boundary passes through keep the Fork.
+		*/
+		cells.links.clear();
+		if(cells.cells == 0) return;
+		for(int i=0; i<D; ++i) {
+			const Interval& interval = root_region(i+1);
+			cells.lower[i] = interval.lower;
+			cells.width[i] = (double(interval.upper) - interval.lower)/cells.cells;
+			if( !(cells.width[i] > 0.0) || !std::isfinite(cells.width[i]) ) return;
+			cells.inverse[i] = 1.0/cells.width[i];
+		}
+		std::size_t total = 1;
+		for(int i=0; i<D; ++i) total *= cells.cells;
+		cells.links.resize(total);
 		
-		if(value.bit) boundary = interval.lower + ratio*(interval.upper - interval.lower);
-		else boundary = interval.lower + (1-ratio)*(interval.upper - interval.lower);
+		struct Block { link_type node; std::array<unsigned int, D> lower, upper; };
+		auto fill = [&cells](const Block& block) {
+			//one run along dimension 1 for each combination of the others
+			std::array<unsigned int, D> at = block.lower;
+			while(true) {
+				std::size_t row = 0;
+				for(int i=D-1; i>0; --i) row = (row + at[i])*cells.cells;
+				std::fill(cells.links.begin() + row + block.lower[0], 
+					  cells.links.begin() + row + block.upper[0], block.node);
+				int i = 1;
+				for(; i<D; ++i) {
+					if(++at[i] < block.upper[i]) break;
+					at[i] = block.lower[i];
+				}
+				if(i == D) return;
+			}
+		};
 		
-		if( !(left->leaf) ) { 
-			Region<D> left_bounds = bounds;
-			left_bounds(value.dimension).upper = boundary;
-			static_cast<Fork*>(left)->update_boundary(left_bounds);
+		Block whole;
+		whole.node = root;
+		whole.lower.fill(0);
+		whole.upper.fill(cells.cells);
+		std::vector<Block> stack(1, whole);
+		while( !stack.empty() ) {
+			Block block = stack.back();
+			stack.pop_back();
+			if( is_leaf(block.node) ) {
+				fill(block);
+				continue;
+			}
+			
+			const Fork& fork = fork_at(block.node);
+			const int d = fork.value.dimension - 1;
+			const double lower = cells.lower[d], width = cells.width[d], slack = 1e-6*width;
+			const num_type boundary = fork.boundary;
+			//first cell not wholly left of the boundary, then first wholly right
+			unsigned int left_end = block.lower[d], right_begin = block.upper[d];
+			for(unsigned int low = left_end, high = block.upper[d]; low < high; ) {
+				unsigned int middle = low + (high - low)/2;
+				if(lower + (middle+1)*width + slack < boundary) low = left_end = middle + 1;
+				else high = middle;
+			}
+			for(unsigned int low = left_end, high = block.upper[d]; low < high; ) {
+				unsigned int middle = low + (high - low)/2;
+				if(lower + middle*width - slack >= boundary) high = right_begin = middle;
+				else low = middle + 1;
+			}
+			
+			Block part = block;
+			part.lower[d] = right_begin;
+			part.node = fork.right;
+			if(right_begin < block.upper[d]) stack.push_back(part);
+			part.lower[d] = block.lower[d];
+			part.upper[d] = left_end;
+			part.node = fork.left;
+			if(block.lower[d] < left_end) stack.push_back(part);
+			part.lower[d] = left_end;
+			part.upper[d] = right_begin;
+			part.node = block.node;
+			if(left_end < right_begin) fill(part);
+		}
+	}
+	
+	template<dim_type D>
+	typename Fern<D>::link_type Fern<D>::start(const Grid* cells, const Point<D>& point) const {
+		if(cells == nullptr) return root;
+		std::size_t index = 0;
+		for(int i=D-1; i>=0; --i) {
+			const num_type x = point(i+1);
+			const Interval& interval = root_region(i+1);
+			if( !(x >= interval.lower && x <= interval.upper) ) return root; //NaN too
+			std::size_t cell = (double(x) - cells->lower[i])*cells->inverse[i];
+			index = index*cells->cells + std::min<std::size_t>(cell, cells->cells-1);
 		}
+		return cells->links[index];
+	}
+	
+	template<dim_type D>
+	void Fern<D>::update_boundary() { 
+		invalidate_grid();
+		root = unshare(root);
+		update_boundary(root, root_region); 
+	}
+	
+	template<dim_type D>
+	void Fern<D>::update_boundary(link_type node, Region<D> bounds) {
+		//node must belong to this Fern alone; shared Forks below it are copied.
+		//One region is narrowed on the way down, logging each interval it 
+		//changes; resuming a right subtree undoes the log back to that fork. 
+		//A chain of forks only ever goes down.
+		const num_type ratio = 2.0/(1.0 + sqrt(5));
+		struct Change { dim_type dimension; Interval interval; };
+		struct Pending { link_type fork; std::size_t changes; };
+		std::vector<Change> log;
+		std::vector<Pending> pending; //forks whose right subtree is still to do
 		
-		if( !(right->leaf) ) {
-			Region<D> right_bounds = bounds;
-			right_bounds(value.dimension).lower = boundary;
-			static_cast<Fork*>(right)->update_boundary(right_bounds);
+		auto descend = [&](const link_type parent, const bool right) -> link_type {
+			Fork& fork = fork_at(parent);
+			Interval& interval = bounds(fork.value.dimension);
+			log.push_back( Change{fork.value.dimension, interval} );
+			if(right) interval.lower = fork.boundary;
+			else interval.upper = fork.boundary;
+			link_type owned = unshare(right ? fork.right : fork.left); //may move the pool
+			if(right) fork_at(parent).right = owned;
+			else fork_at(parent).left = owned;
+			return owned;
+		};
+		
+		while(true) {
+			Fork& fork = fork_at(node);
+			const Interval& interval = bounds(fork.value.dimension);
+			if(fork.value.bit) fork.boundary = interval.lower + ratio*(interval.upper - interval.lower);
+			else fork.boundary = interval.lower + (1-ratio)*(interval.upper - interval.lower);
+			
+			if( !is_leaf(fork.left) ) {
+				if( !is_leaf(fork.right) ) pending.push_back( Pending{node, log.size()} );
+				node = descend(node, false);
+			} else if( !is_leaf(fork.right) ) {
+				node = descend(node, true);
+			} else if( pending.empty() ) {
+				return;
+			} else {
+				const Pending resume = pending.back();
+				pending.pop_back();
+				for(; log.size() > resume.changes; log.pop_back()) 
+					bounds(log.back().dimension) = log.back().interval;
+				node = descend(resume.fork, true);
+			}
 		}
 	}
 
-	//==================== Fern::Leaf methods
+	//==================== Fern::pairing methods ===============
 	template<dim_type D>
-	void Fern<D>::Leaf::print(std::ostream& out, unsigned int depth) const {
-		using namespace std;
-		for(int i=depth; i>0; --i) out << "    ";
-		out << "{B" << bin << "}" << endl;
+	Fern<D>::pairing::pairing(const Fern& one, const Fern& two) : shared() {
+		if(one.max_bin != two.max_bin) return;
+		
+		//preorder over positions where both Ferns have a fork
+		std::vector<Entry> stack;
+		stack.push_back( Entry{one.root, two.root, 0, false} );
+		while( !stack.empty() ) {
+			Entry next = stack.back();
+			stack.pop_back();
+			if( is_leaf(next.one) || is_leaf(next.two) ) continue;
+			
+			std::uint32_t index = shared.size();
+			shared.push_back(next);
+			const Fork& fork_one = one.fork_at(next.one);
+			const Fork& fork_two = two.fork_at(next.two);
+			stack.push_back( Entry{fork_one.right, fork_two.right, index, true} );
+			stack.push_back( Entry{fork_one.left, fork_two.left, index, false} );
+		}
+	}
+	
+	template<dim_type D>
+	bool Fern<D>::pairing::random(node_handle& one, node_handle& two) const {
+		//moves both handles to a uniformly chosen pair; false if there is none,
+		//or if either Fern has lost that pair since
+		if( shared.empty() ) return false;
+		std::uniform_int_distribution<std::size_t> choice(0, shared.size()-1);
+		std::vector<std::uint32_t> chain(1, choice(one.fern->generator));
+		while(chain.back() != 0) chain.push_back( shared[chain.back()].parent );
+		
+		//follow the live trees down, checking each link against the record
+		if( shared[0].one != one.fern->root || shared[0].two != two.fern->root ) return false;
+		std::vector<typename node_handle::Step> path_one, path_two;
+		for(std::size_t i=chain.size()-1; i>0; --i) {
+			const Entry& above = shared[ chain[i] ];
+			const Entry& below = shared[ chain[i-1] ];
+			const Fork& fork_one = one.fern->fork_at(above.one);
+			const Fork& fork_two = two.fern->fork_at(above.two);
+			if( (below.right ? fork_one.right : fork_one.left) != below.one ||
+			    (below.right ? fork_two.right : fork_two.left) != below.two ) return false;
+			path_one.push_back( {above.one, below.right} );
+			path_two.push_back( {above.two, below.right} );
+		}
+		
+		one.path.swap(path_one);
+		one.current = shared[ chain[0] ].one;
+		two.path.swap(path_two);
+		two.current = shared[ chain[0] ].two;
+		return true;
 	}
 
 	//==================== Fern::node_handle methods ============
+	template<dim_type D>
+	bool Fern<D>::node_handle::operator==(const node_handle& rhs) const { 
+		if( fern != rhs.fern || current != rhs.current ) return false;
+		if( path.size() != rhs.path.size() ) return false;
+		for(std::size_t i=0; i<path.size(); ++i) 
+			if( path[i].fork != rhs.path[i].fork || path[i].right != rhs.path[i].right ) 
+				return false;
+		return true;
+	}
+	
+	template<dim_type D>
+	bool Fern<D>::node_handle::claim() {
+		//copies every shared Fork from the root down to current, so that 
+		//changes here reach no other Fern; false for ghosts
+		if( is_ghost() ) return false;
+		fern->invalidate_grid();
+		for(std::size_t i=0; i<path.size(); ++i) {
+			link_type owned = fern->unshare(path[i].fork);
+			if(owned != path[i].fork) {
+				attach(i, owned);
+				path[i].fork = owned;
+			}
+		}
+		if( !is_leaf() ) {
+			link_type owned = fern->unshare(current);
+			if(owned != current) {
+				attach(path.size(), owned);
+				current = owned;
+			}
+		}
+		return true;
+	}
+	
+	template<dim_type D>
+	void Fern<D>::node_handle::attach(const std::size_t depth, const link_type node) {
+		//points the link to the node at this depth of the path at a new node
+		if(depth == 0) fern->root = node;
+		else {
+			const Step& step = path[depth-1];
+			if(step.right) fern->fork_at(step.fork).right = node;
+			else fern->fork_at(step.fork).left = node;
+		}
+	}
+	
+	template<dim_type D>
+	void Fern<D>::node_handle::adjust_sizes(const std::int32_t change) {
+		//wraps like any unsigned sum, so negative changes work; path must be claimed
+		for(const Step& step : path) fern->fork_at(step.fork).size += static_cast<link_type>(change);
+	}
+	
+	template<dim_type D>
+	Region<D> Fern<D>::node_handle::region() const {
+		Region<D> bounds = fern->root_region;
+		for(const Step& step : path) {
+			const Fork& fork = fern->fork_at(step.fork);
+			if(step.right) bounds(fork.value.dimension).lower = fork.boundary;
+			else bounds(fork.value.dimension).upper = fork.boundary;
+		}
+		return bounds;
+	}
+	
 	template<dim_type D>
 	typename Fern<D>::node_handle&  Fern<D>::node_handle::random() {
-		auto it = fern->sbegin(); //depth-first search iterator
-		auto choice = it; 
+		//picks a preorder position, then walks down to it using subtree sizes
+		if( !fern->forks ) return *this; //moved from, so there is no tree
+		std::uniform_int_distribution<link_type> position(0, fern->get_num_nodes()-1);
+		link_type remaining = position(fern->generator);
+		path.clear();
+		current = fern->root;
+		while(remaining > 0) { //so current is a fork
+			--remaining;
+			link_type left_size = fern->subtree_size( fern->fork_at(current).left );
+			if(remaining < left_size) left();
+			else {
+				remaining -= left_size;
+				right();
+			}
+		}
+		return *this;
+	}
 	
-		unsigned int n=1; //number of nodes traversed so far
-		while( !it.is_null() ) { 
-			if( (1.0/n) >= std::generate_canonical<num_type,16>(fern->generator) ) 
-				choice = it;
-			++n; ++it;
+	template<dim_type D>
+	typename Fern<D>::node_handle&  Fern<D>::node_handle::random_leaf() {
+		//same descent as random(), counting leaves only
+		if( !fern->forks ) return *this;
+		std::uniform_int_distribution<link_type> position(0, fern->subtree_leaves(fern->root)-1);
+		link_type remaining = position(fern->generator);
+		path.clear();
+		current = fern->root;
+		while( !is_leaf() ) {
+			link_type left_leaves = fern->subtree_leaves( fern->fork_at(current).left );
+			if(remaining < left_leaves) left();
+			else {
+				remaining -= left_leaves;
+				right();
+			}
 		}
-		*this = choice.get_handle();
 		return *this;
 	}
 	
 	template<dim_type D>
-	bool Fern<D>::node_handle::random_analagous(Fern<D>::node_handle& other) { //random analagous
-		//returns false if owning ferns have different numbers of bins
-		auto original_one = *this;
-		auto original_two = other;
-		root(); other.root();
-		if( get_max_bin() != other.get_max_bin() ) return false; 
-		else {
-			auto choice_one = *this;
-			auto choice_two = other;
-			
-			std::vector<bool> branch_stack; //stack recording traversal choices: left=false, right=true
-			unsigned int n=1; //number of nodes traversed so far
-			while(true) {
-				if(is_leaf() || other.is_leaf()) { 
-				
-					up(); other.up();
-					while(branch_stack.back()) { //until we reach an unexplored right branch
-						up(); other.up();
-						branch_stack.pop_back();
-						if(branch_stack.size() == 0) { //no more unexplored branches
-							*this = choice_one;
-							other = choice_two;
-							return true;
-						}
-					}
-				
-					right(); other.right();
-					branch_stack.back() = true;
-					
-				} else {
-					//test current node
-					if( (1.0/n) >= std::generate_canonical<num_type,16>(fern->generator) ) {
-						choice_one = *this;
-						choice_two = other;
-					}
-					++n;
-				
-					//next left
-					left(); other.left();
-					branch_stack.push_back(false);
-				}
+	typename Fern<D>::node_handle&  Fern<D>::node_handle::random_fork() {
+		//same descent as random(), counting forks only
+		if( !fern->forks ) return *this;
+		std::uniform_int_distribution<link_type> position(0, fern->subtree_forks(fern->root)-1);
+		link_type remaining = position(fern->generator);
+		path.clear();
+		current = fern->root;
+		while(remaining > 0) { //so current has forks below it
+			--remaining;
+			link_type left_forks = fern->subtree_forks( fern->fork_at(current).left );
+			if(remaining < left_forks) left();
+			else {
+				remaining -= left_forks;
+				right();
 			}
 		}
+		return *this;
+	}
+	
+	template<dim_type D>
+	bool Fern<D>::node_handle::random_analagous(Fern<D>::node_handle& other) { //random analagous
+		//returns false if owning ferns have different numbers of bins
+		return pairing(*fern, *other.fern).random(*this, other);
 	}
 	
 	template<dim_type D>
@@ -380,90 +1090,59 @@ namespace clau {
 	template<dim_type D>
 	bool Fern<D>::node_handle::splice(const node_handle& other) {
 		//returns false if current points to a ghost or root
-		if( !is_root() ) {
-			auto target_ptr = current;
-			up();
-			auto parent_ptr = static_cast<Fork*>(current);
-			if( parent_ptr->left == target_ptr ) {
-			
-				delete target_ptr;
-				target_ptr = nullptr;
-				if( other.is_leaf() ) 
-					parent_ptr->left = new Leaf( *static_cast<Leaf*>(other.current) );
-				else 	parent_ptr->left = new Fork( *static_cast<Fork*>(other.current) );
-				left();
-				current->parent = parent_ptr;
-				fern->update_boundary();
-				return true;
-				
-			} else if( parent_ptr->right == target_ptr ) {
-			
-				delete target_ptr;
-				target_ptr = nullptr;
-				if( other.is_leaf() ) 
-					parent_ptr->right = new Leaf( *static_cast<Leaf*>(other.current) );
-				else 	parent_ptr->right = new Fork( *static_cast<Fork*>(other.current) );
-				right();
-				current->parent = parent_ptr;
-				fern->update_boundary();
-				return true;
-			
-			} else {
-				current = target_ptr;
-				return false; //current points to a ghost
-			}
-		} else return false; //current points to root
+		if( is_root() || other.is_ghost() || !claim() ) return false;
+		
+		//a subtree from the same pool is shared rather than copied, unless 
+		//it encloses this position; take it before letting go of the old one
+		link_type target = current;
+		bool shareable = fern->forks == other.fern->forks;
+		for(const Step& step : path) 
+			if(step.fork == other.current) shareable = false; 
+		if(shareable) current = fern->share(other.current);
+		else current = fern->clone(*other.fern->forks, other.current);
+		
+		std::int32_t change = fern->subtree_size(current) - fern->subtree_size(target);
+		fern->release(target);
+		attach(path.size(), current);
+		adjust_sizes(change);
+		
+		//boundaries carry over only if the region does
+		Region<D> bounds = region();
+		if( !is_leaf() && !(bounds == other.region()) ) {
+			link_type owned = fern->unshare(current);
+			attach(path.size(), owned);
+			current = owned;
+			fern->update_boundary(current, bounds);
+		}
+		return true;
 	}
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::split_leaf(const Division<D> new_value) {
 		//returns false for forks or if leaf is a ghost
-		if( current->leaf ) {
-			
-			auto leaf_ptr = static_cast<Leaf*>(current);
-			bin_type kept_bin = leaf_ptr->bin; //same for both new leaves
-			up();
-			auto parent_ptr = static_cast<Fork*>(current);
-			if( parent_ptr->left == leaf_ptr ) {
-			
-				delete leaf_ptr;
-				leaf_ptr = nullptr;
-				parent_ptr->left = new Fork(parent_ptr, new_value, 
-							    kept_bin, kept_bin);
-				left();
-				fern->update_boundary();
-				return true;
-			
-			} else if ( parent_ptr->right == leaf_ptr ) {
-			
-				delete leaf_ptr;
-				leaf_ptr = nullptr;
-				parent_ptr->right = new Fork(parent_ptr, new_value, 
-							     kept_bin, kept_bin);
-				right();
-				fern->update_boundary();
-				return true;
-			
-			} else {
-				current = leaf_ptr;
-				return false; //leaf is a ghost
-			}
-			
-		} else return false; //current points to a fork
+		if( !is_leaf() || !claim() ) return false;
+		
+		bin_type kept_bin = bin_of(current); //same for both new leaves
+		current = fern->new_fork(new_value, kept_bin, kept_bin);
+		attach(path.size(), current);
+		adjust_sizes(2);
+		fern->update_boundary( current, region() );
+		return true;
 	}
 	
 	template<dim_type D>
 	bin_type Fern<D>::node_handle::get_leaf_bin() const {
 		if( !is_leaf() ) return 0;
-		else return static_cast<Leaf*>(current)->bin;
+		else return bin_of(current);
 	}
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::set_leaf_bin(const bin_type new_bin) {
-		//returns false for forks or if new_bin is out-of-range
-		if( current->leaf && (new_bin <= fern->max_bin) ) {
+		//returns false for forks, ghosts or if new_bin is out-of-range
+		if( is_leaf() && (new_bin <= fern->max_bin) && claim() ) {
 		
-			static_cast<Leaf*>(current)->bin = new_bin;
+			current = leaf_link(new_bin);
+			attach(path.size(), current);
 			return true;
 			
 		} else return false;
@@ -471,75 +1150,48 @@ namespace clau {
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::merge_fork(const bin_type kept_bin) {
-		//returns false for leaves, if both children are not leaves,
-		// or if fork is a ghost or root
-		if( !current->leaf && !is_root() ) {
-			auto fork_ptr = static_cast<Fork*>(current);
-			//if(fork_ptr->left->leaf && fork_ptr->right->leaf) {
-			
-			//either keep bin of _larger interval_ or left leaf 
-			//bin_type kept_bin;
-			//if(fork_ptr->value.bit) kept_bin = static_cast<Leaf*>(fork_ptr->left)->bin;
-			//else kept_bin = static_cast<Leaf*>(fork_ptr->right)->bin;
-			
-			up();
-			auto parent_ptr = static_cast<Fork*>(current); 
-			if( parent_ptr->left == fork_ptr ) {
-			
-				delete fork_ptr;
-				fork_ptr = nullptr;
-				parent_ptr->left = new Leaf(parent_ptr, kept_bin);
-				left();
-				return true;
-				
-			} else if( parent_ptr->right == fork_ptr) {
-			
-				delete fork_ptr;
-				fork_ptr = nullptr;
-				parent_ptr->right = new Leaf(parent_ptr, kept_bin);
-				right();
-				return true;
-				
-			} else {
-				current = fork_ptr; //return to original node
-				return false; //fork is a ghost
-			}
-				
-			//} else return false; //both children are not leaves
-		} else return false; //current points to a leaf or root
+		//returns false for leaves, or if fork is a ghost or root
+		if( is_leaf() || is_root() || !claim() ) return false;
+		
+		std::int32_t change = 1 - fern->subtree_size(current);
+		fern->release(current);
+		current = leaf_link(kept_bin);
+		attach(path.size(), current);
+		adjust_sizes(change);
+		return true;
 	}
 	
 	template<dim_type D>
 	num_type Fern<D>::node_handle::get_fork_boundary() const {
-		if( is_leaf() ) return 0.0;
-		else return static_cast<Fork*>(current)->boundary;
+		if( !at_fork() ) return 0.0;
+		else return fern->fork_at(current).boundary;
 	}
 	
 	template<dim_type D>
 	dim_type Fern<D>::node_handle::get_fork_dimension() const {
-		if( is_leaf() ) return 0;
-		else return static_cast<Fork*>(current)->value.dimension;
+		if( !at_fork() ) return 0;
+		else return fern->fork_at(current).value.dimension;
 	}
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::get_fork_bit() const {
-		if( is_leaf() ) return false;
-		else return static_cast<Fork*>(current)->value.bit;
+		if( !at_fork() ) return false;
+		else return fern->fork_at(current).value.bit;
 	}
 	
 	template<dim_type D>
 	Division<D> Fern<D>::node_handle::get_fork_division() const {
-		if( is_leaf() ) return false;
-		else return static_cast<Fork*>(current)->value;
+		if( !at_fork() ) return false;
+		else return fern->fork_at(current).value;
 	}
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::set_fork_dimension(const dim_type new_dimension) {
-		//returns false for leaves or if new_dimension is out-of-range
-		if( !is_leaf() && (new_dimension <= D) && (new_dimension > 0) ) {
+		//returns false for leaves, ghosts or if new_dimension is out-of-range
+		if( !is_leaf() && (new_dimension <= D) && (new_dimension > 0) && claim() ) {
 		
-			static_cast<Fork*>(current)->value.dimension = new_dimension;
-			fern->update_boundary(); 
+			fern->fork_at(current).value.dimension = new_dimension;
+			fern->update_boundary( current, region() );
 			return true;
 			
 		} else return false;
@@ -547,11 +1199,11 @@ namespace clau {
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::set_fork_bit(const bool new_bit) {
-		//returns false for leaves
-		if( !is_leaf() ) {
+		//returns false for leaves and ghosts
+		if( !is_leaf() && claim() ) {
 		
-			static_cast<Fork*>(current)->value.bit = new_bit;
-			fern->update_boundary(); //doesn't run properly
+			fern->fork_at(current).value.bit = new_bit;
+			fern->update_boundary( current, region() );
 			return true;
 			
 		} else return false;
@@ -559,10 +1211,10 @@ namespace clau {
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::set_fork_division(const Division<D> division) {
-		if( !is_leaf() ) {
+		if( !is_leaf() && claim() ) {
 		
-			static_cast<Fork*>(current)->value = division;
-			fern->update_boundary(); //doesn't run properly
+			fern->fork_at(current).value = division;
+			fern->update_boundary( current, region() );
 			return true;
 			
 		} else return false;
@@ -570,13 +1222,14 @@ namespace clau {
 	
 	template<dim_type D>
 	bool Fern<D>::node_handle::is_ghost() const {
-	
-		if( is_root() ) return false;
-		auto target_ptr = current;
-		auto parent_ptr = static_cast<Fork*>(current->parent);
-		if( (parent_ptr->left == target_ptr) || (parent_ptr->right == target_ptr) ) 
-			return false;
-		else return true;
+		//true unless the path still leads from this Fern's root to current
+		link_type node = fern->root;
+		for(const Step& step : path) {
+			if(step.fork != node) return true;
+			const Fork& fork = fern->fork_at(node);
+			node = step.right ? fork.right : fork.left;
+		}
+		return node != current;
 	}
 	
 	template<dim_type D>
@@ -617,6 +1270,60 @@ namespace clau {
 		operator++();
 		return temp;
 	}
+	
+	//=================== Fern::leaf_iterator methods ==================
+	template<dim_type D>
+	Fern<D>::leaf_iterator::leaf_iterator(const Fern* pFern) 
+		: fern(pFern), path(), current() {
+		current.region = fern->root_region;
+		descend(fern->root);
+	}
+	
+	template<dim_type D>
+	void Fern<D>::leaf_iterator::descend(link_type node) {
+		while( !is_leaf(node) ) {
+			const Fork& fork = fern->fork_at(node);
+			Interval& interval = current.region(fork.value.dimension);
+			path.push_back( Step{node, interval, false} );
+			interval.upper = fork.boundary;
+			node = fork.left;
+		}
+		current.bin = bin_of(node);
+	}
+	
+	template<dim_type D>
+	typename Fern<D>::leaf_iterator& Fern<D>::leaf_iterator::operator++() {
+		//back up past right turns, putting their intervals back, then go right
+		while( !path.empty() && path.back().right ) {
+			const Step& step = path.back();
+			current.region(fern->fork_at(step.fork).value.dimension) = step.saved;
+			path.pop_back();
+		}
+		if( path.empty() ) {
+			fern = nullptr;
+			return *this;
+		}
+		Step& step = path.back();
+		const Fork& fork = fern->fork_at(step.fork);
+		Interval& interval = current.region(fork.value.dimension);
+		interval = step.saved;
+		interval.lower = fork.boundary;
+		step.right = true;
+		descend(fork.right);
+		return *this;
+	}
+	
+	template<dim_type D>
+	bool Fern<D>::leaf_iterator::operator==(const leaf_iterator& rhs) const {
+		//the same Fern and the same way down, or both at the end
+		if(fern != rhs.fern) return false;
+		if(fern == nullptr) return true;
+		if(path.size() != rhs.path.size()) return false;
+		for(std::size_t i=0; i<path.size(); ++i) 
+			if(path[i].fork != rhs.path[i].fork || path[i].right != rhs.path[i].right) 
+				return false;
+		return true;
+	}
 
 } //namespace clau
 
@@ -21,13 +21,21 @@
     e-mail: jackwhall7@gmail.com
 */
 
+#include <atomic>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <vector>
 #include <array>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include "Parallel.h"
+#include "Pool.h"
 
 namespace clau {
 	
@@ -218,97 +226,133 @@ namespace clau {
 		return out;
 	}
 	
+	template<dim_type D> class CompiledFern;
+	
 	template<dim_type D>
 	class Fern {
 	public:
-		class node_handle; //forward declaration as a friend class for Node and Fork
+		class node_handle; //forward declaration
+		class pairing;
 		
 	private:
-		struct Node {
-		/*
-			The Node class provides a common interface for Forks and Leaves. 
-		*/
-			Node* parent;
-			const bool leaf;
-		
-			Node() = delete;
-			Node(Node* pParent, const bool bLeaf) : parent(pParent), leaf(bLeaf) {}
-			Node(const Node& rhs) = default;
-			Node& operator=(const Node& rhs) = default;
-			virtual ~Node() = default;
-			
-			virtual void print(std::ostream& out, unsigned int depth) const {}
-		}; //class Node
-	
-		struct Fork;
-
-		struct Leaf : public Node {
 		/*
-			A Leaf adds a bin number to the Node interface. Its version of query 
-			returns the bin number. 
+			Forks are plain records in an index-based pool and refer to their 
+			children with 32-bit links. A link with the top bit set is a leaf 
+			and holds the leaf's bin itself, so leaves take no storage. A Fern 
+			shares its pool, and every subtree it has not changed, with the 
+			Fern it was copied from; Forks count their owners instead of 
+			pointing back at a parent, and a shared Fork is copied before it 
+			is changed (see node_handle::claim). Ferns that share a pool may 
+			be read from many threads at once, but while one of them is 
+			being changed no other may be read or changed from another 
+			thread: adding a Fork can move the whole pool. 
 		*/
-		private:
-			bin_type bin;
-			friend class node_handle;
-			template<dim_type T> friend struct fern_pickle;
+		typedef std::uint32_t link_type;
+		static const link_type leaf_flag = 0x80000000;
+		static const link_type no_link = 0xFFFFFFFF; //null handles
 		
-		public:
-			Leaf() = delete;
-			Leaf(Fork* pParent, const bin_type nBin) 
-				: Node(pParent, true), bin(nBin) {}
-			Leaf(const Leaf& rhs) = default;
-			Leaf& operator=(const Leaf& rhs) = default;
-			virtual ~Leaf() noexcept = default;
-			
-			virtual void print(std::ostream& out, unsigned int depth) const;
-			bin_type query() const { return bin; }
-		}; //class Leaf
+		static bool is_leaf(const link_type link) { return link & leaf_flag; }
+		static link_type leaf_link(const bin_type bin) { return bin | leaf_flag; }
+		static bin_type bin_of(const link_type link) { return link & ~leaf_flag; }
 	
-		struct Fork : public Node {
+		struct Fork {
 		/*
 			The Fork class stores its boundary as a num_type and a bool that tells 
 			whether the boundary is on the left or right of the current region in
 			the dimension specified. Note that the boundary is stored for 
-			convenience only; it is not an independent property. 
+			convenience only; it is not an independent property. Each Fork also
+			counts the nodes in its subtree, itself included, so that a random 
+			node can be found by descending from the root, and the Forks and 
+			Ferns that link to it.
 		*/
-		private: 
-			Node *left, *right;
-			Division<D> value;
+			link_type left, right;
+			link_type size;
+			link_type owners;
 			num_type boundary;
-			friend class node_handle;
-			template<dim_type T> friend struct fern_pickle;
+			Division<D> value;
 			
-			Fork(Fork* pParent, const Division<D> cValue);
+			Fork(const Division<D> cValue) 
+				: left(no_link), right(no_link), size(1), owners(1), 
+				  boundary(0.0), value(cValue) {}
+		}; //struct Fork
+		typedef Pool<Fork> fork_pool;
 		
-		public:
-			Fork() = delete;
-			Fork(Fork* pParent, const Division<D> cValue, 
-			     const bin_type left_bin, const bin_type right_bin);
-			Fork(const Fork& rhs);
-			Fork& operator=(const Fork& rhs);
-			virtual ~Fork() noexcept;
+		struct Grid {
+		/*
+			An optional uniform grid over root_region for D <= 3. Each cell 
+			holds the leaf link when one leaf covers it, or else the deepest 
+			Fork whose region does, and queries inside the region start 
+			there. Cells are found with a little slack, so a point always 
+			lands in one whose Fork it would reach from the root. Changes to 
+			the Fern only mark the grid stale; the next query rebuilds it, 
+			and concurrent queries wait for that one build.
+		*/
+			unsigned int cells; //per dimension, after the memory cap
+			std::size_t max_bytes;
+			std::array<double, D> lower, width, inverse;
+			std::vector<link_type> links; //dimension 1 fastest; empty if the region is
+			std::atomic<bool> ready;
+			std::mutex building;
 			
-			virtual void print(std::ostream& out, unsigned int depth) const;
-			bin_type query(const Point<D> point) const;
-			void update_boundary(const Region<D> bounds);
-		}; //class Fork
+			Grid(const unsigned int cCells, const std::size_t cMax_bytes) 
+				: cells(cCells), max_bytes(cMax_bytes), ready(false) {}
+		}; //struct Grid
 
-		Fork* root;
+		std::shared_ptr<fork_pool> forks; //shared with copies of this Fern
+		link_type root; //always a Fork
 		Region<D> root_region;
 		bin_type max_bin;
 		mutable rng_type generator;
 		float node_type_chance, mutation_type_chance_leaf, mutation_type_chance_fork;
-		
-		void update_boundary() { root->update_boundary(root_region); }
+		std::unique_ptr<Grid> grid; //null unless set_grid turned one on
+		
+		Fork& fork_at(const link_type link) { return (*forks)[link]; }
+		const Fork& fork_at(const link_type link) const { return (*forks)[link]; }
+		link_type subtree_size(const link_type link) const 
+			{ return is_leaf(link) ? 1 : fork_at(link).size; }
+		//every Fork has two children, so n nodes are (n+1)/2 leaves and (n-1)/2 forks
+		link_type subtree_leaves(const link_type link) const 
+			{ return (subtree_size(link)+1)/2; }
+		link_type subtree_forks(const link_type link) const 
+			{ return (subtree_size(link)-1)/2; }
+		
+		link_type share(const link_type node) 
+			{ if( !is_leaf(node) ) ++fork_at(node).owners; return node; }
+		link_type unshare(const link_type fork); //a private copy if others own fork
+		void release(const link_type node) { release(*forks, node); }
+		static void release(fork_pool& pool, const link_type node);
+		
+		void update_boundary(); //of the whole tree
+		void update_boundary(link_type fork, Region<D> bounds); //fork unshared
+		bin_type query_node(link_type fork, const Point<D>& point) const;
+		
+		static std::unique_ptr<Grid> copy_grid(const std::unique_ptr<Grid>& source);
+		void invalidate_grid() { if(grid) grid->ready.store(false, std::memory_order_relaxed); }
+		const Grid* ready_grid() const; //null if there is none to use; rebuilds a stale one
+		void build_grid(Grid& cells) const;
+		link_type start(const Grid* cells, const Point<D>& point) const; //fork or leaf
+		void print(std::ostream& out, const link_type node, unsigned int depth) const;
+		
+		link_type new_fork(const Division<D> value, 
+				   const bin_type left_bin, const bin_type right_bin);
+		link_type clone(const fork_pool& source, const link_type node);
 		
 	public:
 		Fern();
 		explicit Fern(const bin_type numBins);
 		Fern(const Region<D> bounds, const bin_type numBins=1.0);
 		Fern(const Fern& rhs);
+		Fern(Fern&& rhs) noexcept; //leaves rhs empty
 		Fern& operator=(const Fern& rhs);
+		Fern& operator=(Fern&& rhs) noexcept; //leaves rhs with the old tree
 		~Fern();
 		
+		//swaps trees, settings and generators; handles follow the object, 
+		//not the tree. A moved-from Fern may only be assigned to or destroyed.
+		//Handles into it are ghosts: they refuse changes, don't move, and 
+		//their fork getters answer as a leaf's do. Don't pair them. 
+		void swap(Fern& other) noexcept;
+		
 		//need to add these functions to test code
 		bool set_node_type_chance(const float chance);
 		bool set_mutation_type_chance(const float chance_fork, const float chance_leaf);
@@ -316,67 +360,124 @@ namespace clau {
 		float get_node_type_chance() { return node_type_chance; }
 		float get_mutation_type_chance_leaf() { return mutation_type_chance_leaf; }
 		float get_mutation_type_chance_fork() { return mutation_type_chance_fork; }
+		void seed(const rng_type::result_type value) { generator.seed(value); }
 		
 		void set_bounds(const Region<D> bounds);
+		void compact(); //moves this Fern to a pool of its own
+		std::size_t footprint() const { return forks->footprint(); } //of the shared pool
+		static std::size_t fork_size() { return sizeof(Fork); }
 		//left out a way to change the number of bins, might need to add it back later
 		
 		Region<D> get_region() const { return root_region; }
 		Interval get_bounds(const dim_type dimension) const 
 			{ return root_region(dimension); }
 		bin_type get_num_bins() const { return max_bin+1; }
+		std::size_t get_num_nodes() const { return fork_at(root).size; } //forks and leaves
+		
+		//an acceleration grid of resolution cells per dimension, fewer if 
+		//they would take more than max_bytes; 0 turns it off, and D > 3 
+		//returns false. See struct Grid.
+		static const std::size_t grid_bytes = 1 << 20;
+		bool set_grid(const unsigned int resolution, const std::size_t max_bytes=grid_bytes);
+		unsigned int get_grid_resolution() const { return grid ? grid->cells : 0; }
+		
+		//versioned binary format, described in Fern.cpp; a failed load
+		//returns false and leaves the Fern as it was
+		static const std::uint16_t binary_version = 1;
+		void save_binary(std::ostream& out) const;
+		std::string save_binary() const;
+		bool load_binary(std::istream& in);
+		bool load_binary(const char* data, const std::size_t size);
 		
 		void randomize(const unsigned int mutations);
 		void mutate();
 		void crossover(const Fern& other); 
-		bin_type query(const Point<D> point) const { return root->query(point); }
+		void crossover(const Fern& other, const pairing& shared); //shared from (*this, other)
+		bin_type query(const Point<D> point) const;
+		
+		//batch queries write one bin per point; threads=0 uses every core
+		void query_batch(const num_type* points, const std::size_t count, 
+		                 bin_type* bins, const unsigned int threads=1) const; //AoS
+		void query_batch(const std::array<const num_type*, D>& columns, 
+		                 const std::size_t count, bin_type* bins, 
+		                 const unsigned int threads=1) const; //SoA
+		void query_batch(const std::array<const num_type*, D>& bases, 
+		                 const std::size_t stride, const std::size_t count, 
+		                 bin_type* bins, const unsigned int threads=1) const; //strided
+		
+		//bins at the pixel centers of a width x height image over window, 
+		//row-major from the lower corner; see Fern.cpp
+		void rasterize(const Region<D>& window, const std::size_t width, 
+		               const std::size_t height, bin_type* image, 
+		               const unsigned int threads=1) const;
 		
 		template<dim_type T>
 		friend std::ostream& operator<<(std::ostream& out, const Fern<T>& fern);
 		
 		template<dim_type T> friend struct fern_pickle;
+		template<dim_type T> friend class CompiledFern;
 	
 		class node_handle {
 		/*
-			node_handle provides safe external access to Nodes. 
+			node_handle provides safe external access to Nodes. Since Forks 
+			don't know their parents, a handle remembers the way down from the 
+			root. Changing the Fern through one handle turns other handles to 
+			the changed part of the tree into ghosts. 
 		*/
 		private:
-			Node* current;
+			struct Step { link_type fork; bool right; };
+			std::vector<Step> path; //from the root to the parent of current
+			link_type current;
 			Fern* fern;
 			
-			node_handle(Fern* pFern) : current(pFern->root), fern(pFern) {}
+			node_handle(Fern* pFern) : path(), current(pFern->root), fern(pFern) {}
 			friend node_handle Fern::begin();
+			friend class Fern;
+			friend class pairing;
+			
+			bool claim(); //makes the path and current private to this Fern
+			void attach(const std::size_t depth, const link_type node);
+			void adjust_sizes(const std::int32_t change);
+			Region<D> region() const;
+			bool at_fork() const { return !is_leaf() && fern->forks; } //none once moved from
 			
 		public:
-			node_handle() : current(nullptr), fern(nullptr) {}
+			node_handle() : path(), current(no_link), fern(nullptr) {}
 			node_handle(const node_handle& rhs) = default;
 			node_handle& operator=(const node_handle& rhs) = default;
 			~node_handle() = default;
 			
-			bool operator==(const node_handle& rhs) const { return current == rhs.current; }
-			bool operator!=(const node_handle& rhs) const { return current != rhs.current; }
+			//leaf links are bins, so position is what tells nodes apart
+			bool operator==(const node_handle& rhs) const;
+			bool operator!=(const node_handle& rhs) const { return !(*this == rhs); }
 			
 			node_handle& up() { 
-				if(current->parent != nullptr) current = current->parent; 
+				if( !path.empty() ) {
+					current = path.back().fork;
+					path.pop_back();
+				}
 				return *this;
 			}
 			
 			node_handle& left() { 
-				if(!current->leaf) { 
-					Fork* fork_ptr = static_cast<Fork*>(current);
-					current = fork_ptr->left; 
+				if( at_fork() ) {
+					path.push_back( Step{current, false} );
+					current = fern->fork_at(current).left;
 				}
 				return *this;
 			}
 			
 			node_handle& right() { 
-				if(!current->leaf) {
-					Fork* fork_ptr = static_cast<Fork*>(current);
-					current = fork_ptr->right; 
+				if( at_fork() ) {
+					path.push_back( Step{current, true} );
+					current = fern->fork_at(current).right;
 				}
 				return *this;
 			}
 			
 			node_handle& random();
+			node_handle& random_leaf(); //uniform over leaves only
+			node_handle& random_fork(); //uniform over forks only
 			bool random_analagous(node_handle& other); 
 			node_handle& root() { while( !is_root() ) up(); return *this; }
 			
@@ -398,14 +499,41 @@ namespace clau {
 			Division<D> get_fork_division() const;
 			bool set_fork_division(const Division<D> division);
 			
-			bool is_leaf() const { return current->leaf; }
-			bool is_root() const { return current->parent == nullptr; }
+			bool is_leaf() const { return Fern::is_leaf(current); }
+			bool is_root() const { return path.empty(); }
 			bool is_ghost() const;
 			bool belongs_to(const Fern& owner); 
 		}; //class node_handle
 		
 		node_handle begin() { return node_handle(this); } 
 		bool random_analagous(node_handle& one, node_handle& two); 
+		
+		class pairing {
+		/*
+			A pairing lists the forks two Ferns have in the same place, in 
+			depth-first order, so that crossover can pick an analogous pair with
+			one draw. It also fits unmodified copies of either Fern, since 
+			copies share their nodes. A pair that no longer exists in both 
+			Ferns is refused. Ferns with different numbers of bins share nothing.
+		*/
+		private:
+			struct Entry { 
+				link_type one, two; 
+				std::uint32_t parent; //entry of the enclosing pair
+				bool right; 
+			};
+			std::vector<Entry> shared; 
+		
+		public:
+			pairing() = default;
+			pairing(const Fern& one, const Fern& two);
+			pairing(const pairing& rhs) = default;
+			pairing& operator=(const pairing& rhs) = default;
+			~pairing() = default;
+			
+			std::size_t size() const { return shared.size(); }
+			bool random(node_handle& one, node_handle& two) const; 
+		}; //class pairing
 	
 		class dfs_iterator {
 		private:
@@ -448,8 +576,59 @@ namespace clau {
 		
 		dfs_iterator sbegin() { return dfs_iterator(this); }
 		
+		struct leaf {
+			Region<D> region; //narrowed by the stored boundaries, never widened
+			bin_type bin;
+		};
+		
+		class leaf_iterator {
+		/*
+			leaf_iterator visits every leaf, left to right, with its region.
+			It keeps one region and the way back up, so advancing allocates 
+			only when the walk reaches a depth it hasn't been to before. The 
+			Fern must not change while it's being walked.
+		*/
+		private:
+			struct Step { link_type fork; Interval saved; bool right; };
+			const Fern* fern; //null at the end
+			std::vector<Step> path;
+			leaf current;
+			
+			leaf_iterator(const Fern* pFern);
+			void descend(link_type node); //to the leftmost leaf below node
+			friend class Fern;
+		
+		public:
+			typedef std::input_iterator_tag iterator_category;
+			typedef leaf value_type;
+			typedef std::ptrdiff_t difference_type;
+			typedef const leaf* pointer;
+			typedef const leaf& reference;
+			
+			leaf_iterator() : fern(nullptr), path(), current() {}
+			
+			bool operator==(const leaf_iterator& rhs) const;
+			bool operator!=(const leaf_iterator& rhs) const { return !(*this == rhs); }
+			const leaf& operator*() const { return current; }
+			const leaf* operator->() const { return &current; }
+			leaf_iterator& operator++();
+		}; //class leaf_iterator
+		
+		struct leaf_range {
+			leaf_iterator first;
+			leaf_iterator begin() const { return first; }
+			leaf_iterator end() const { return leaf_iterator(); }
+		};
+		
+		//for(auto& leaf : fern.leaves()) visits (region, bin) pairs left to right
+		leaf_range leaves() const { return leaf_range{ leaf_iterator(this) }; }
+		std::size_t get_num_leaves() const { return subtree_leaves(root); }
+		
 	}; //class Fern
 	
+	template<dim_type D>
+	void swap(Fern<D>& one, Fern<D>& two) noexcept { one.swap(two); }
+	
 } //namespace clau
 
 #include "Fern.cpp"
@@ -0,0 +1,165 @@
+#ifndef MappedFern_cpp
+#define MappedFern_cpp
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace clau {
+
+	//=================== MappedFern methods ======================
+	template<dim_type D>
+	const std::uint32_t MappedFern<D>::file_version;
+
+	template<dim_type D>
+	MappedFern<D>::MappedFern() 
+		: mapping(), records(nullptr), count(0), root_region(), max_bin(0) {}
+
+	template<dim_type D>
+	MappedFern<D>::MappedFern(const std::string& path) : MappedFern() { open(path); }
+
+	template<dim_type D>
+	MappedFern<D>::MappedFern(MappedFern&& rhs) : MappedFern() { *this = std::move(rhs); }
+
+	template<dim_type D>
+	MappedFern<D>& MappedFern<D>::operator=(MappedFern&& rhs) {
+		if(this != &rhs) {
+			mapping = std::move(rhs.mapping);
+			records = rhs.records;
+			count = rhs.count;
+			root_region = rhs.root_region;
+			max_bin = rhs.max_bin;
+			rhs.close();
+		}
+		return *this;
+	}
+
+	template<dim_type D>
+	bool MappedFern<D>::open(const std::string& path) {
+		close();
+		FileMapping file;
+		if( !file.open(path) || file.size() < sizeof(Header) ) return false;
+
+		//only the header is checked, so opening costs the same for any size
+		const char* bytes = file.data();
+		const std::size_t size = file.size();
+		Header header;
+		std::memcpy(&header, bytes, sizeof(Header));
+		const std::size_t region_end = sizeof(Header) + 2*D*sizeof(num_type);
+		if( std::memcmp(header.magic, "FERNMAP", 8) != 0 || header.version != file_version || 
+		    header.byte_order != 0x01020304 || header.dimensions != D || 
+		    header.max_bin > std::numeric_limits<bin_type>::max() || header.records == 0 || 
+		    header.offset % 64 != 0 || header.offset < region_end || header.offset > size || 
+		    (size - header.offset) % sizeof(Record) != 0 || 
+		    header.records != (size - header.offset)/sizeof(Record) ) return false; //no overflow
+
+		records = reinterpret_cast<const Record*>(bytes + header.offset);
+		count = header.records;
+		max_bin = header.max_bin;
+		const char* limits = bytes + sizeof(Header);
+		for(int i=1; i<=D; ++i) {
+			std::memcpy(&root_region(i).lower, limits + (2*i-2)*sizeof(num_type), sizeof(num_type));
+			std::memcpy(&root_region(i).upper, limits + (2*i-1)*sizeof(num_type), sizeof(num_type));
+		}
+		mapping = std::move(file);
+		return true;
+	}
+
+	template<dim_type D>
+	void MappedFern<D>::close() {
+		mapping.close();
+		records = nullptr;
+		count = 0;
+		root_region = Region<D>();
+		max_bin = 0;
+	}
+
+	template<dim_type D>
+	bool MappedFern<D>::verify() const {
+		//children come after their parents, so a verified file can't loop
+		if( !is_open() ) return false;
+		for(std::size_t i=0; i<count; ++i) {
+			if(records[i].coordinate >= D) return false;
+			for(auto link : records[i].child) {
+				if( CompiledFern<D>::is_leaf(link) ) {
+					if(CompiledFern<D>::get_bin(link) > max_bin) return false;
+				} else if(link <= i || link >= count) return false;
+			}
+		}
+		return true;
+	}
+
+	template<dim_type D>
+	bin_type MappedFern<D>::query(const Point<D>& point) const {
+		typename CompiledFern<D>::link_type link = 0;
+		do {
+			const Record& fork = records[link];
+			link = fork.child[ !(point(fork.coordinate+1) < fork.boundary) ];
+		} while( !CompiledFern<D>::is_leaf(link) );
+		return CompiledFern<D>::get_bin(link);
+	}
+
+	template<dim_type D>
+	void MappedFern<D>::query_batch(const num_type* points, const std::size_t count, 
+					bin_type* bins, const unsigned int threads) const {
+		bases_type bases;
+		for(int i=0; i<D; ++i) bases[i] = points + i;
+		query_batch(bases, D, count, bins, threads);
+	}
+
+	template<dim_type D>
+	void MappedFern<D>::query_batch(const bases_type& bases, const std::size_t stride, 
+					const std::size_t count, bin_type* bins, 
+					const unsigned int threads, const kernel_type kernel) const {
+		CompiledFern<D>::query_records(records, bases, stride, count, bins, threads, kernel);
+	}
+
+	template<dim_type D>
+	bool MappedFern<D>::write(const CompiledFern<D>& fern, const std::string& path) {
+		Header header;
+		std::memcpy(header.magic, "FERNMAP", 8);
+		header.version = file_version;
+		header.byte_order = 0x01020304;
+		header.dimensions = D;
+		header.max_bin = fern.get_num_bins() - 1;
+		header.records = fern.size();
+		const std::size_t region_end = sizeof(Header) + 2*D*sizeof(num_type);
+		header.offset = (region_end + 63)/64*64; //keeps records on cache lines
+
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+		Region<D> region = fern.get_region();
+		for(int i=1; i<=D; ++i) {
+			out.write(reinterpret_cast<const char*>(&region(i).lower), sizeof(num_type));
+			out.write(reinterpret_cast<const char*>(&region(i).upper), sizeof(num_type));
+		}
+		const char padding[64] = {};
+		out.write(padding, header.offset - region_end);
+		out.write(reinterpret_cast<const char*>(fern.data()), fern.size()*sizeof(Record));
+		out.close();
+		return !out.fail();
+	}
+
+} //namespace clau
+
+#endif
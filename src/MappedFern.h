@@ -0,0 +1,108 @@
+#ifndef MappedFern_h
+#define MappedFern_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "Fern.h"
+#include "CompiledFern.h"
+#include "Mapping.h"
+
+namespace clau {
+
+	template<dim_type D>
+	class MappedFern {
+	/*
+		A MappedFern queries a model file in place. The file holds a short 
+		header, the root region and CompiledFern's fixed-width records, so
+		opening one is an mmap and a header check: nothing is read, parsed 
+		or allocated per node, and pages are faulted in as queries touch 
+		them. Mappings are read-only and shared, so any number of threads 
+		or processes can query one file at once. Files are in the writing
+		machine's byte order and are refused elsewhere.
+	*/
+	public:
+		typedef typename CompiledFern<D>::Record Record;
+		typedef typename CompiledFern<D>::bases_type bases_type;
+		static const std::uint32_t file_version = 1;
+
+		struct Header { //followed by D (lower, upper) float pairs
+			char magic[8]; //"FERNMAP"
+			std::uint32_t version;
+			std::uint32_t byte_order; //0x01020304 as written
+			std::uint32_t dimensions;
+			std::uint32_t max_bin;
+			std::uint64_t records;
+			std::uint64_t offset; //of the first record, a multiple of 64
+		};
+
+	private:
+		FileMapping mapping;
+		const Record* records;
+		std::size_t count;
+		Region<D> root_region;
+		bin_type max_bin;
+
+	public:
+		MappedFern();
+		explicit MappedFern(const std::string& path); //check is_open()
+		MappedFern(MappedFern&& rhs);
+		MappedFern& operator=(MappedFern&& rhs);
+		MappedFern(const MappedFern& rhs) = delete;
+		MappedFern& operator=(const MappedFern& rhs) = delete;
+		~MappedFern() { close(); }
+
+		//returns false if the file can't be mapped or isn't a model file for D
+		bool open(const std::string& path);
+		void close();
+		bool is_open() const { return mapping.is_open(); }
+
+		//walks every record once; open() trusts the file, this doesn't
+		bool verify() const;
+
+		//only for an open MappedFern; same results as CompiledFern
+		bin_type query(const Point<D>& point) const;
+		void query_batch(const num_type* points, const std::size_t count, 
+		                 bin_type* bins, const unsigned int threads=1) const; //AoS
+		void query_batch(const bases_type& bases, const std::size_t stride, 
+		                 const std::size_t count, bin_type* bins, 
+		                 const unsigned int threads=1, 
+		                 const kernel_type kernel=best_kernel()) const; //strided
+
+		Region<D> get_region() const { return root_region; }
+		bin_type get_num_bins() const { return max_bin+1; }
+		std::size_t size() const { return count; }
+		const Record* data() const { return records; }
+
+		//returns false if the file can't be written
+		static bool write(const CompiledFern<D>& fern, const std::string& path);
+		static bool write(const Fern<D>& fern, const std::string& path) {
+			return write(CompiledFern<D>(fern), path);
+		}
+	}; //class MappedFern
+
+} //namespace clau
+
+#include "MappedFern.cpp"
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef Mapping_h
+#define Mapping_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace clau {
+
+	class FileMapping {
+	/*
+		A whole file mapped read-only and shared, for readers that want 
+		their data in place rather than copied in. Any number of threads 
+		may read a mapping at once. Moving hands it over; it's unmapped 
+		when the last owner goes.
+	*/
+		const char* bytes;
+		std::size_t length;
+
+	public:
+		FileMapping() : bytes(nullptr), length(0) {}
+		FileMapping(FileMapping&& rhs) : bytes(rhs.bytes), length(rhs.length) { 
+			rhs.bytes = nullptr; 
+			rhs.length = 0;
+		}
+		FileMapping& operator=(FileMapping&& rhs) {
+			if(this != &rhs) {
+				close();
+				std::swap(bytes, rhs.bytes);
+				std::swap(length, rhs.length);
+			}
+			return *this;
+		}
+		FileMapping(const FileMapping& rhs) = delete;
+		FileMapping& operator=(const FileMapping& rhs) = delete;
+		~FileMapping() { close(); }
+
+		bool open(const std::string& path) {
+			//returns false if the file can't be opened or is empty
+			close();
+			int file = ::open(path.c_str(), O_RDONLY);
+			if(file < 0) return false;
+			struct stat status;
+			if( fstat(file, &status) != 0 || status.st_size <= 0 ) {
+				::close(file);
+				return false;
+			}
+			void* map = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+			::close(file); //the mapping keeps the file open
+			if(map == MAP_FAILED) return false;
+			bytes = static_cast<const char*>(map);
+			length = status.st_size;
+			return true;
+		}
+
+		void close() {
+			if(bytes) munmap(const_cast<char*>(bytes), length);
+			bytes = nullptr;
+			length = 0;
+		}
+
+		bool is_open() const { return bytes != nullptr; }
+		const char* data() const { return bytes; } //page-aligned
+		std::size_t size() const { return length; }
+	}; //class FileMapping
+
+} //namespace clau
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef Parallel_h
+#define Parallel_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace clau {
+
+	inline unsigned int resolve_threads(unsigned int threads) {
+		//0 means "one per core"
+		if(threads == 0) threads = std::thread::hardware_concurrency();
+		return threads == 0 ? 1 : threads;
+	}
+
+	template<class Function>
+	void parallel_for(const std::size_t count, unsigned int threads,
+	                  const std::size_t grain, Function fn) {
+	/*
+		Splits [0, count) into one contiguous chunk per thread and calls
+		fn(begin, end) on each, using the calling thread for the first chunk.
+		Only as many threads are used as there are whole grains of work, so 
+		no chunk is smaller than grain and small jobs stay serial. If fn
+		throws, the first exception is rethrown here once every thread has
+		been joined.
+	*/
+		threads = resolve_threads(threads);
+		std::size_t useful = grain > 0 ? count/grain : count;
+		if(useful < threads) threads = useful;
+		if(threads <= 1) {
+			if(count > 0) fn(std::size_t(0), count);
+			return;
+		}
+
+		std::exception_ptr failure;
+		std::mutex failure_lock;
+		auto guarded = [&failure, &failure_lock](Function& body, std::size_t begin, 
+							 std::size_t end) {
+			try {
+				body(begin, end);
+			} catch(...) {
+				std::lock_guard<std::mutex> guard(failure_lock);
+				if( !failure ) failure = std::current_exception();
+			}
+		};
+
+		std::vector<std::thread> workers;
+		std::size_t chunk = count/threads, extra = count%threads;
+		std::size_t first_end = chunk + (extra > 0 ? 1 : 0);
+		try {
+			workers.reserve(threads-1);
+			std::size_t begin = first_end;
+			for(unsigned int i=1; i<threads; ++i) {
+				std::size_t end = begin + chunk + (i < extra ? 1 : 0);
+				//each worker calls a copy of fn, as std::thread(fn, ...) would
+				workers.push_back( std::thread([&guarded, fn, begin, end]() mutable { 
+					guarded(fn, begin, end); }) );
+				begin = end;
+			}
+			guarded(fn, 0, first_end);
+		} catch(...) { //a thread that couldn't start; its chunk is left undone
+			std::lock_guard<std::mutex> guard(failure_lock);
+			if( !failure ) failure = std::current_exception();
+		}
+		for(auto& worker : workers) worker.join();
+		if(failure) std::rethrow_exception(failure);
+	}
+
+	template<class Function>
+	void work_stealing_for(const std::size_t count, unsigned int threads, Function fn) {
+	/*
+		Calls fn(i) once for every i in [0, count), for tasks whose costs 
+		vary too much to split evenly ahead of time. Each thread starts 
+		with a contiguous share and works from its front; a thread that 
+		runs dry takes the back half of the largest share left. The calling
+		thread works too. If fn throws, or a thread can't be started, no 
+		new tasks are started and the first exception is rethrown here 
+		once every thread has stopped.
+	*/
+		struct Share {
+			std::mutex lock;
+			std::size_t begin, end;
+		};
+		
+		threads = resolve_threads(threads);
+		if(threads > count) threads = count;
+		if(threads <= 1) {
+			for(std::size_t i=0; i<count; ++i) fn(i);
+			return;
+		}
+		
+		std::vector<Share> shares(threads);
+		for(unsigned int w=0; w<threads; ++w) {
+			shares[w].begin = count*w/threads;
+			shares[w].end = count*(w+1)/threads;
+		}
+		std::atomic<bool> failed(false);
+		std::exception_ptr failure;
+		std::mutex failure_lock;
+		
+		auto work = [&](const unsigned int w) {
+			Share& own = shares[w];
+			while( !failed.load() ) {
+				std::size_t task;
+				{
+					std::lock_guard<std::mutex> guard(own.lock);
+					task = own.begin < own.end ? own.begin++ : count;
+				}
+				if(task == count) { //steal; only one lock is ever held at a time
+					unsigned int victim = w;
+					std::size_t most = 0;
+					for(unsigned int v=0; v<threads; ++v) {
+						std::lock_guard<std::mutex> guard(shares[v].lock);
+						if(shares[v].end - shares[v].begin > most) {
+							most = shares[v].end - shares[v].begin;
+							victim = v;
+						}
+					}
+					if(most == 0) return; //tasks in flight belong to their thieves
+					std::size_t begin, end;
+					{
+						std::lock_guard<std::mutex> guard(shares[victim].lock);
+						end = shares[victim].end;
+						begin = end - (end - shares[victim].begin + 1)/2;
+						shares[victim].end = begin;
+					}
+					std::lock_guard<std::mutex> guard(own.lock);
+					own.begin = begin;
+					own.end = end;
+					continue;
+				}
+				try {
+					fn(task);
+				} catch(...) {
+					std::lock_guard<std::mutex> guard(failure_lock);
+					if( !failure ) failure = std::current_exception();
+					failed = true;
+				}
+			}
+		};
+		
+		std::vector<std::thread> workers;
+		try {
+			workers.reserve(threads-1);
+			for(unsigned int w=1; w<threads; ++w) workers.push_back( std::thread(work, w) );
+			work(0);
+		} catch(...) { //a thread that couldn't start; the ones that did stop early
+			std::lock_guard<std::mutex> guard(failure_lock);
+			if( !failure ) failure = std::current_exception();
+			failed = true;
+		}
+		for(auto& worker : workers) worker.join();
+		if(failure) std::rethrow_exception(failure);
+	}
+
+} //namespace clau
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef Pool_h
+#define Pool_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace clau {
+
+	template<class T>
+	class Pool {
+	/*
+		A Pool keeps objects of one type in a single contiguous array and hands
+		out 32-bit indices instead of pointers, so indices survive growth and a
+		whole pool copies with one allocation. Released slots go on a vacancy
+		list and are reused before the array grows; a released slot keeps its
+		old contents until then. T should be a small, trivially copyable record.
+	*/
+	public:
+		typedef std::uint32_t index_type;
+
+	private:
+		std::vector<T> slots;
+		std::vector<index_type> vacant;
+
+	public:
+		Pool() = default;
+		Pool(const Pool& rhs) = default;
+		Pool& operator=(const Pool& rhs) = default;
+		~Pool() = default;
+
+		template<class... Args>
+		index_type create(Args&&... args) {
+			if( !vacant.empty() ) {
+				index_type index = vacant.back();
+				vacant.pop_back();
+				slots[index] = T( std::forward<Args>(args)... );
+				return index;
+			}
+			slots.push_back( T(std::forward<Args>(args)...) );
+			return slots.size() - 1;
+		}
+
+		void destroy(const index_type index) { vacant.push_back(index); }
+
+		T& operator[](const index_type index) { return slots[index]; }
+		const T& operator[](const index_type index) const { return slots[index]; }
+
+		void reserve(const std::size_t count) { slots.reserve(slots.size() + count); }
+		void clear() { slots.clear(); vacant.clear(); }
+		void swap(Pool& other) { slots.swap(other.slots); vacant.swap(other.vacant); }
+
+		std::size_t size() const { return slots.size() - vacant.size(); } //live objects
+		std::size_t footprint() const { //bytes held, including spare capacity
+			return slots.capacity()*sizeof(T) + vacant.capacity()*sizeof(index_type);
+		}
+	}; //class Pool
+
+} //namespace clau
+
+#endif
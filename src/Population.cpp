@@ -0,0 +1,213 @@
+#ifndef Population_cpp
+#define Population_cpp
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+
+namespace clau {
+
+	//=================== Population methods ======================
+	template<dim_type D>
+	Population<D>::Population(const Fern<D>& ancestor, const std::size_t size,
+				  fitness_type function)
+		: Population(std::vector< Fern<D> >(size, ancestor), function) {}
+
+	template<dim_type D>
+	Population<D>::Population(const std::vector< Fern<D> >& founders, fitness_type function)
+		: members(founders), offspring(founders), scores(founders.size(), 0.0),
+		  timings(founders.size(), 0.0), scored(false), fitness(function), 
+		  generation(0), threads(1), elites(1),
+		  mutation_rate(0.4), crossover_rate(0.2), selection(roulette_selection),
+		  tournament_size(2) {
+		//defaults follow demo/classify_fern.py
+		std::random_device device;
+		generator.seed( device() );
+		if(members.size() < 2) elites = 0; //one elite would leave no room to breed
+	}
+
+	template<dim_type D>
+	void Population<D>::seed(const rng_type::result_type value) {
+		//members get seeds of their own, so copies of one parent still differ
+		generator.seed(value);
+		for(auto& member : members) member.seed( generator() );
+		for(auto& member : offspring) member.seed( generator() );
+	}
+
+	template<dim_type D>
+	bool Population<D>::set_elites(const unsigned int count) {
+		//returns false if there would be no room left to breed
+		if(count < members.size()) {
+			elites = count;
+			return true;
+		} else return false;
+	}
+
+	template<dim_type D>
+	bool Population<D>::set_mutation_rate(const float rate) {
+		//returns false if rate is out of range
+		if(rate>=0.0 && rate<=1.0) {
+			mutation_rate = rate;
+			return true;
+		} else return false;
+	}
+
+	template<dim_type D>
+	bool Population<D>::set_crossover_rate(const float rate) {
+		//returns false if rate is out of range
+		if(rate>=0.0 && rate<=1.0) {
+			crossover_rate = rate;
+			return true;
+		} else return false;
+	}
+
+	template<dim_type D>
+	bool Population<D>::set_tournament(const unsigned int size) {
+		//returns false for an empty tournament
+		if(size == 0) return false;
+		selection = tournament_selection;
+		tournament_size = size;
+		return true;
+	}
+
+	template<dim_type D>
+	void Population<D>::set_member(const std::size_t index, const Fern<D>& member) {
+		members[index] = member;
+		scored = false;
+	}
+
+	template<dim_type D>
+	void Population<D>::randomize(const unsigned int mutations) {
+		for(auto& member : members) member.randomize(mutations);
+		scored = false;
+	}
+
+	template<dim_type D>
+	void Population<D>::evaluate() {
+		//members are only read, so they need no copying or locking
+		work_stealing_for(members.size(), threads, [this](std::size_t i) {
+			auto start = std::chrono::steady_clock::now();
+			scores[i] = fitness(members[i]);
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			timings[i] = elapsed.count();
+		});
+		scored = true;
+	}
+
+	template<dim_type D>
+	std::size_t Population<D>::best() {
+		if(!scored) evaluate();
+		return std::max_element(scores.begin(), scores.end()) - scores.begin();
+	}
+
+	template<dim_type D>
+	void Population<D>::build_alias_table() {
+		//Vose's method; a generation with no positive fitness is drawn uniformly
+		const std::size_t count = members.size();
+		chance.assign(count, 1.0);
+		alias.resize(count);
+		std::iota(alias.begin(), alias.end(), 0);
+
+		double total = 0.0;
+		for(double score : scores) if(score > 0.0) total += score;
+		if( !(total > 0.0) || !std::isfinite(total) ) return;
+
+		std::vector<std::uint32_t> small, large;
+		for(std::size_t i=0; i<count; ++i) {
+			chance[i] = scores[i] > 0.0 ? scores[i]*count/total : 0.0;
+			if(chance[i] < 1.0) small.push_back(i);
+			else large.push_back(i);
+		}
+		while( !small.empty() && !large.empty() ) {
+			std::uint32_t less = small.back(), more = large.back();
+			small.pop_back();
+			alias[less] = more;
+			chance[more] -= 1.0 - chance[less];
+			if(chance[more] < 1.0) {
+				large.pop_back();
+				small.push_back(more);
+			}
+		}
+		//whatever is left is 1 up to rounding
+		for(std::uint32_t i : small) chance[i] = 1.0;
+		for(std::uint32_t i : large) chance[i] = 1.0;
+	}
+
+	template<dim_type D>
+	std::size_t Population<D>::select() {
+		std::uniform_int_distribution<std::size_t> uniform(0, members.size()-1);
+		std::size_t choice = uniform(generator);
+		if(selection == roulette_selection) {
+			std::bernoulli_distribution keep(chance[choice]);
+			return keep(generator) ? choice : alias[choice];
+		}
+		for(unsigned int i=1; i<tournament_size; ++i) {
+			std::size_t rival = uniform(generator);
+			if(scores[rival] > scores[choice]) choice = rival;
+		}
+		return choice;
+	}
+
+	template<dim_type D>
+	void Population<D>::breed() {
+		if( members.empty() ) return;
+		if(!scored) evaluate();
+		if(selection == roulette_selection) build_alias_table();
+
+		//elites go first, fittest at the front
+		std::vector<std::uint32_t> order(members.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::partial_sort(order.begin(), order.begin()+elites, order.end(),
+			[this](std::uint32_t a, std::uint32_t b) { return scores[a] > scores[b]; });
+
+		//offspring kept the last generation's Ferns, so assigning reuses them
+		offspring.resize( members.size() );
+		std::bernoulli_distribution cross(crossover_rate), mutate(mutation_rate);
+		for(std::size_t i=0; i<members.size(); ++i) {
+			if(i < elites) {
+				offspring[i] = members[ order[i] ];
+				continue;
+			}
+			offspring[i] = members[ select() ];
+			if( cross(generator) ) offspring[i].crossover( members[select()] );
+			if( mutate(generator) ) offspring[i].mutate();
+		}
+
+		members.swap(offspring);
+		scored = false;
+		++generation;
+	}
+
+	template<dim_type D>
+	void Population<D>::run(const unsigned int generations) {
+		if(!scored) evaluate();
+		for(unsigned int i=0; i<generations; ++i) {
+			breed();
+			evaluate();
+		}
+	}
+
+} //namespace clau
+
+#endif
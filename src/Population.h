@@ -0,0 +1,117 @@
+#ifndef Population_h
+#define Population_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "Fern.h"
+
+namespace clau {
+
+	//how parents are drawn from a scored generation
+	enum selection_type { roulette_selection, tournament_selection };
+
+	template<dim_type D>
+	class Population {
+	/*
+		A Population owns a generation of Ferns and breeds the next one in
+		place: the best members are carried over unchanged (elitism), and
+		every other slot is a copy of a selected parent, crossed over with a
+		second parent and then mutated, each with its own probability.
+		Roulette selection draws parents in proportion to fitness from an
+		alias table, one draw in constant time; negative fitness counts as
+		zero. Tournament selection takes the fittest of a few uniform draws.
+		Copies share subtrees, so members only own the nodes they changed.
+		With more than one thread, fitness is called from several threads
+		at once on members that share nodes; it may query them but must not
+		copy or change them.
+	*/
+	public:
+		typedef std::function<double(const Fern<D>&)> fitness_type;
+
+	private:
+		std::vector< Fern<D> > members, offspring; //offspring is reused storage
+		std::vector<double> scores;
+		std::vector<double> timings; //seconds each score took
+		bool scored; //scores belong to the current members
+		fitness_type fitness;
+		rng_type generator;
+		unsigned int generation;
+		unsigned int threads;
+
+		unsigned int elites;
+		float mutation_rate, crossover_rate;
+		selection_type selection;
+		unsigned int tournament_size;
+
+		//Vose alias table: slot i keeps itself with chance[i], else gives alias[i]
+		std::vector<double> chance;
+		std::vector<std::uint32_t> alias;
+
+		void build_alias_table();
+		std::size_t select();
+
+	public:
+		Population(const Fern<D>& ancestor, const std::size_t size, fitness_type function);
+		Population(const std::vector< Fern<D> >& founders, fitness_type function);
+		Population(const Population& rhs) = default;
+		Population& operator=(const Population& rhs) = default;
+		~Population() = default;
+
+		void set_fitness(fitness_type function) { fitness = function; scored = false; }
+		void seed(const rng_type::result_type value); //this and every member
+		void set_threads(const unsigned int count) { threads = count; } //0 uses every core
+		unsigned int get_threads() const { return threads; }
+
+		bool set_elites(const unsigned int count);
+		bool set_mutation_rate(const float rate);
+		bool set_crossover_rate(const float rate);
+		void set_roulette() { selection = roulette_selection; }
+		bool set_tournament(const unsigned int size);
+
+		unsigned int get_elites() const { return elites; }
+		float get_mutation_rate() const { return mutation_rate; }
+		float get_crossover_rate() const { return crossover_rate; }
+		selection_type get_selection() const { return selection; }
+		unsigned int get_tournament_size() const { return tournament_size; }
+		unsigned int get_generation() const { return generation; }
+
+		void randomize(const unsigned int mutations); //every member
+		void evaluate(); //scores every member, spread over threads by work stealing
+		void breed(); //replaces the members with their offspring, scoring first if needed
+		void run(const unsigned int generations); //breed and evaluate, so scores stay current
+
+		std::size_t size() const { return members.size(); }
+		const Fern<D>& operator[](const std::size_t index) const { return members[index]; }
+		void set_member(const std::size_t index, const Fern<D>& member);
+		const std::vector< Fern<D> >& get_members() const { return members; }
+		const std::vector<double>& get_fitness() { if(!scored) evaluate(); return scores; }
+		const std::vector<double>& get_timings() const { return timings; } //of the last evaluate
+		std::size_t best(); //index of the fittest member
+	}; //class Population
+
+} //namespace clau
+
+#include "Population.cpp"
+
+#endif
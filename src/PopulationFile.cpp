@@ -0,0 +1,168 @@
+#ifndef PopulationFile_cpp
+#define PopulationFile_cpp
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include "Parallel.h"
+
+namespace clau {
+
+	/*
+		File layout, all little-endian: "FPOP", uint16 version, uint16 D and
+		uint32 count, then per Fern a uint64 offset from the start of the 
+		file, uint32 byte count and float64 fitness, then the Ferns' binary 
+		formats (see Fern.cpp) in the same order.
+	*/
+
+	template<dim_type D>
+	bool save_population(const std::string& path, const std::vector< Fern<D> >& ferns, 
+			     const std::vector<double>& fitness, const unsigned int threads) {
+		std::vector<const Fern<D>*> pointers;
+		pointers.reserve( ferns.size() );
+		for(auto& fern : ferns) pointers.push_back(&fern);
+		return save_population(path, pointers, fitness, threads);
+	}
+
+	template<dim_type D>
+	bool save_population(const std::string& path, const std::vector<const Fern<D>*>& ferns, 
+			     const std::vector<double>& fitness, const unsigned int threads) {
+		if( fitness.size() != ferns.size() ) return false;
+		
+		//reading Ferns that share nodes from several threads is safe
+		std::vector<std::string> saved( ferns.size() );
+		parallel_for(ferns.size(), threads, 16, [&](std::size_t begin, std::size_t end) {
+			for(std::size_t i=begin; i<end; ++i) saved[i] = ferns[i]->save_binary();
+		});
+		return write_population<D>(path, saved, fitness);
+	}
+
+	template<dim_type D>
+	bool write_population(const std::string& path, const std::vector<std::string>& saved, 
+			      const std::vector<double>& fitness) {
+		typedef PopulationFile<D> file_type;
+		const std::size_t count = saved.size();
+		if( fitness.size() != count || count > std::numeric_limits<std::uint32_t>::max() ) 
+			return false;
+		
+		std::string contents;
+		contents.reserve(file_type::header_size + count*file_type::entry_size);
+		byte_writer out(contents);
+		contents.append("FPOP", 4);
+		out.put(file_type::file_version, 2);
+		out.put(D, 2);
+		out.put(count, 4);
+		std::uint64_t offset = file_type::header_size + count*file_type::entry_size;
+		for(std::size_t i=0; i<count; ++i) {
+			std::uint64_t bits;
+			std::memcpy(&bits, &fitness[i], 8);
+			out.put(offset, 4);
+			out.put(offset >> 32, 4);
+			out.put(saved[i].size(), 4);
+			out.put(bits, 4);
+			out.put(bits >> 32, 4);
+			offset += saved[i].size();
+		}
+		
+		std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+		file.write(contents.data(), contents.size());
+		for(auto& fern : saved) file.write(fern.data(), fern.size());
+		file.close();
+		return !file.fail();
+	}
+
+	//=================== PopulationFile methods ======================
+	template<dim_type D>
+	const std::uint16_t PopulationFile<D>::file_version;
+	template<dim_type D>
+	const std::size_t PopulationFile<D>::header_size;
+	template<dim_type D>
+	const std::size_t PopulationFile<D>::entry_size;
+
+	template<dim_type D>
+	bool PopulationFile<D>::open(const std::string& path) {
+		close();
+		FileMapping file;
+		if( !file.open(path) || file.size() < header_size || 
+		    std::memcmp(file.data(), "FPOP", 4) != 0 ) return false;
+		byte_reader in(file.data(), file.size());
+		in.position = 4;
+		std::uint32_t version, dimensions, count;
+		in.get(version, 2);
+		in.get(dimensions, 2);
+		in.get(count, 4);
+		if( version != file_version || dimensions != D || 
+		    (file.size() - header_size)/entry_size < count ) return false;
+		
+		//the table is read up front, the Ferns aren't
+		const std::uint64_t first = header_size + std::uint64_t(count)*entry_size;
+		std::vector<Entry> table(count);
+		std::vector<double> scores(count);
+		for(std::uint32_t i=0; i<count; ++i) {
+			std::uint32_t words[5];
+			for(auto& word : words) in.get(word, 4);
+			table[i].offset = words[0] | std::uint64_t(words[1]) << 32;
+			table[i].bytes = words[2];
+			std::uint64_t bits = words[3] | std::uint64_t(words[4]) << 32;
+			std::memcpy(&scores[i], &bits, 8);
+			if( table[i].offset < first || table[i].offset > file.size() || 
+			    file.size() - table[i].offset < table[i].bytes ) return false;
+		}
+		
+		mapping = std::move(file);
+		entries.swap(table);
+		fitness.swap(scores);
+		return true;
+	}
+
+	template<dim_type D>
+	void PopulationFile<D>::close() {
+		mapping.close();
+		entries.clear();
+		fitness.clear();
+	}
+
+	template<dim_type D>
+	bool PopulationFile<D>::load(const std::size_t index, Fern<D>& fern) const {
+		const Entry& entry = entries[index];
+		return fern.load_binary(mapping.data() + entry.offset, entry.bytes);
+	}
+
+	template<dim_type D>
+	bool PopulationFile<D>::load_all(std::vector< Fern<D> >& ferns, 
+					 const unsigned int threads) const {
+		//fresh Ferns, so no two threads release nodes from one shared pool
+		ferns.clear();
+		ferns.resize( size() );
+		std::atomic<bool> loaded(true);
+		parallel_for(size(), threads, 16, [&](std::size_t begin, std::size_t end) {
+			for(std::size_t i=begin; i<end; ++i) 
+				if( !load(i, ferns[i]) ) loaded = false;
+		});
+		return loaded;
+	}
+
+} //namespace clau
+
+#endif
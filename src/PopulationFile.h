@@ -0,0 +1,100 @@
+#ifndef PopulationFile_h
+#define PopulationFile_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Fern.h"
+#include "Mapping.h"
+
+namespace clau {
+
+	/*
+		Writes ferns and their fitness to path as one file: a header, a 
+		table of contents giving each Fern's fitness and where its binary 
+		format starts, then the Ferns back to back. Ferns are serialized 
+		on threads (0 uses every core) and written in one pass. Returns 
+		false if fitness doesn't have one value per Fern or the file 
+		can't be written.
+	*/
+	template<dim_type D>
+	bool save_population(const std::string& path, const std::vector< Fern<D> >& ferns, 
+			     const std::vector<double>& fitness, const unsigned int threads=1);
+	template<dim_type D>
+	bool save_population(const std::string& path, const std::vector<const Fern<D>*>& ferns, 
+			     const std::vector<double>& fitness, const unsigned int threads=1);
+	//the write alone, for Ferns already in their binary format (Fern::save_binary)
+	template<dim_type D>
+	bool write_population(const std::string& path, const std::vector<std::string>& saved, 
+			      const std::vector<double>& fitness);
+
+	template<dim_type D>
+	class PopulationFile {
+	/*
+		A PopulationFile maps a file written by save_population. Opening it
+		reads only the header and table of contents; each Fern is parsed
+		when it's loaded, so members can be loaded lazily, in any order, or
+		from several threads at once.
+	*/
+	public:
+		static const std::uint16_t file_version = 1;
+		static const std::size_t header_size = 12; //"FPOP", version, D, count
+		static const std::size_t entry_size = 20; //offset, bytes, fitness
+
+	private:
+		struct Entry {
+			std::uint64_t offset;
+			std::uint32_t bytes;
+		};
+
+		FileMapping mapping;
+		std::vector<Entry> entries;
+		std::vector<double> fitness;
+
+	public:
+		PopulationFile() = default;
+		explicit PopulationFile(const std::string& path) { open(path); } //check is_open()
+		PopulationFile(PopulationFile&& rhs) = default;
+		PopulationFile& operator=(PopulationFile&& rhs) = default;
+		~PopulationFile() = default;
+
+		//returns false if the file can't be mapped or isn't a population of Fern<D>
+		bool open(const std::string& path);
+		void close();
+		bool is_open() const { return mapping.is_open(); }
+
+		std::size_t size() const { return entries.size(); }
+		const std::vector<double>& get_fitness() const { return fitness; }
+
+		//returns false if that Fern is damaged, leaving fern as it was
+		bool load(const std::size_t index, Fern<D>& fern) const;
+		//every Fern, spread over threads; returns false if any is damaged
+		bool load_all(std::vector< Fern<D> >& ferns, const unsigned int threads=1) const;
+	}; //class PopulationFile
+
+} //namespace clau
+
+#include "PopulationFile.cpp"
+
+#endif
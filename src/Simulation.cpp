@@ -0,0 +1,211 @@
+#ifndef Simulation_cpp
+#define Simulation_cpp
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
+#include <utility>
+
+namespace clau {
+
+	inline double thrust_for(const bin_type mode, const double thrust) {
+		return mode == 1 ? -thrust : mode == 2 ? thrust : 0.0;
+	}
+
+	inline Plant<2> satellite_plant(const double thrust, const double inertia) {
+		return Plant<2>( [thrust, inertia](const Plant<2>::state_type& state,
+						   const bin_type mode) {
+			Plant<2>::state_type derivative = {{ state[1]/inertia, thrust_for(mode, thrust) }};
+			return derivative;
+		});
+	}
+
+	inline Plant<1> velocity_plant(const double thrust) {
+		return Plant<1>( [thrust](const Plant<1>::state_type&, const bin_type mode) {
+			Plant<1>::state_type derivative = {{ thrust_for(mode, thrust) }};
+			return derivative;
+		});
+	}
+
+	template<dim_type D>
+	class Integrator {
+	/*
+		One step of classic RK4, or of Dormand-Prince 5(4) with the scaled
+		difference of its two solutions as the error estimate; the mode
+		is held for the whole step.
+	*/
+		typedef typename Plant<D>::state_type state_type;
+		const Plant<D>& plant;
+		const SimulationSettings& settings;
+
+		static state_type along(const state_type& y, const double h,
+					std::initializer_list<std::pair<double, const state_type*>> terms) {
+			state_type sum = y;
+			for(auto& term : terms)
+				for(int i=0; i<D; ++i) sum[i] += h*term.first*(*term.second)[i];
+			return sum;
+		}
+
+	public:
+		Integrator(const Plant<D>& cPlant, const SimulationSettings& cSettings)
+			: plant(cPlant), settings(cSettings) {}
+
+		double step(const state_type& y, const bin_type mode, const double h,
+			    state_type& next) const {
+			//returns the error relative to tolerance; above 1 means retry
+			auto& f = plant.dynamics;
+			if( !settings.adaptive ) {
+				state_type k1 = f(y, mode);
+				state_type k2 = f(along(y, h, {{0.5, &k1}}), mode);
+				state_type k3 = f(along(y, h, {{0.5, &k2}}), mode);
+				state_type k4 = f(along(y, h, {{1.0, &k3}}), mode);
+				next = along(y, h, {{1.0/6, &k1}, {1.0/3, &k2}, {1.0/3, &k3}, {1.0/6, &k4}});
+				return 0.0;
+			}
+			state_type k1 = f(y, mode);
+			state_type k2 = f(along(y, h, {{1.0/5, &k1}}), mode);
+			state_type k3 = f(along(y, h, {{3.0/40, &k1}, {9.0/40, &k2}}), mode);
+			state_type k4 = f(along(y, h, {{44.0/45, &k1}, {-56.0/15, &k2},
+						       {32.0/9, &k3}}), mode);
+			state_type k5 = f(along(y, h, {{19372.0/6561, &k1}, {-25360.0/2187, &k2},
+						       {64448.0/6561, &k3}, {-212.0/729, &k4}}), mode);
+			state_type k6 = f(along(y, h, {{9017.0/3168, &k1}, {-355.0/33, &k2},
+						       {46732.0/5247, &k3}, {49.0/176, &k4},
+						       {-5103.0/18656, &k5}}), mode);
+			next = along(y, h, {{35.0/384, &k1}, {500.0/1113, &k3}, {125.0/192, &k4},
+					    {-2187.0/6784, &k5}, {11.0/84, &k6}});
+			state_type k7 = f(next, mode);
+			//fifth order minus embedded fourth order
+			state_type error = along(state_type(), h, {{71.0/57600, &k1}, {-71.0/16695, &k3},
+					{71.0/1920, &k4}, {-17253.0/339200, &k5}, {22.0/525, &k6},
+					{-1.0/40, &k7}});
+			double worst = 0.0;
+			for(int i=0; i<D; ++i) {
+				double scale = settings.tolerance*(1.0 + std::max(std::fabs(y[i]),
+										  std::fabs(next[i])));
+				worst = std::max(worst, std::fabs(error[i])/scale);
+			}
+			return worst;
+		}
+	};
+
+	template<dim_type D, class Controller>
+	Trajectory<D> simulate(const Plant<D>& plant, const Controller& control,
+			       const typename Plant<D>::state_type& initial,
+			       const SimulationSettings& settings) {
+		typedef typename Plant<D>::state_type state_type;
+		Integrator<D> integrator(plant, settings);
+		auto mode_at = [&control, &settings](const state_type& y) -> bin_type {
+			double norm = 0.0;
+			Point<D> point;
+			for(int i=0; i<D; ++i) {
+				norm += std::fabs(y[i]);
+				point(i+1) = y[i];
+			}
+			return norm < settings.dead_zone ? 0 : control.query(point);
+		};
+
+		Trajectory<D> trajectory;
+		trajectory.steps = 0;
+		double t = 0.0, h = settings.dt;
+		state_type y = initial;
+		bin_type mode = mode_at(y);
+		trajectory.times.push_back(t);
+		trajectory.states.push_back(y);
+
+		//t_final counts as reached within a rounding error
+		const double end = settings.t_final*(1.0 - 1e-12);
+		while(t < end && trajectory.steps < settings.step_budget) {
+			double taken = std::min(h, settings.t_final - t);
+			state_type next;
+			double error = integrator.step(y, mode, taken, next);
+			++trajectory.steps;
+			if(error > 1.0) {
+				h = taken*std::max(0.2, 0.9*std::pow(error, -0.2));
+				continue;
+			}
+
+			if(mode_at(next) != mode) {
+				//bisect for the first time the mode differs; next stays past it
+				double before = 0.0, after = taken;
+				while(after - before > settings.event_tolerance &&
+				      trajectory.steps < settings.step_budget) {
+					double middle = 0.5*(before + after);
+					state_type trial;
+					integrator.step(y, mode, middle, trial);
+					++trajectory.steps;
+					if(mode_at(trial) != mode) {
+						after = middle;
+						next = trial;
+					} else before = middle;
+				}
+				taken = after;
+			}
+
+			t += taken;
+			y = next;
+			trajectory.times.push_back(t);
+			trajectory.states.push_back(y);
+			trajectory.modes.push_back(mode);
+			mode = mode_at(y);
+			if(settings.adaptive)
+				h = std::min(settings.dt, taken*std::min(5.0, 0.9*std::pow(
+					std::max(error, 1e-10), -0.2)));
+		}
+		trajectory.modes.push_back(mode);
+		trajectory.finished = t >= end;
+		return trajectory;
+	}
+
+	template<dim_type D>
+	double absolute_error(const Trajectory<D>& trajectory, const double t_final,
+			      const double penalty) {
+		auto size = [](const std::array<double, D>& state) {
+			double sum = 0.0;
+			for(int i=0; i<D; ++i) sum += std::fabs(state[i]);
+			return sum;
+		};
+		double total = 0.0;
+		for(std::size_t n=1; n<trajectory.times.size(); ++n)
+			total += 0.5*(trajectory.times[n] - trajectory.times[n-1])*
+				 (size(trajectory.states[n]) + size(trajectory.states[n-1]));
+		if( !trajectory.finished )
+			total += 0.5*(t_final - trajectory.times.back())*
+				 (1.0 + penalty)*size(trajectory.states.back());
+		return total;
+	}
+
+	template<dim_type D, class Controller>
+	double tracking_error(const Plant<D>& plant, const Controller& control,
+			      const std::vector<typename Plant<D>::state_type>& initial,
+			      const SimulationSettings& settings, const double penalty) {
+		double total = 0.0;
+		for(auto& state : initial)
+			total += absolute_error(simulate(plant, control, state, settings),
+						settings.t_final, penalty);
+		return total;
+	}
+
+} //namespace clau
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef Simulation_h
+#define Simulation_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <array>
+#include <functional>
+#include <vector>
+#include "Fern.h"
+
+namespace clau {
+
+	template<dim_type D>
+	struct Plant {
+	/*
+		A Plant is a system of D first-order ODEs whose right-hand side
+		depends on a control mode, the bin a controller puts the state in.
+		The demo plants push with -thrust in mode 1, +thrust in mode 2 and
+		not at all in any other mode.
+	*/
+		typedef std::array<double, D> state_type;
+		typedef std::function<state_type(const state_type& state, const bin_type mode)>
+			dynamics_type;
+
+		dynamics_type dynamics;
+
+		Plant() = default;
+		explicit Plant(dynamics_type function) : dynamics(function) {}
+	};
+
+	//demo/satellite_fern.py: state is (angle, angular momentum)
+	Plant<2> satellite_plant(const double thrust=0.5, const double inertia=100.0);
+	//demo/velocity_control.py: state is (velocity)
+	Plant<1> velocity_plant(const double thrust=0.5);
+
+	struct SimulationSettings {
+		double t_final;
+		double dt; //the fixed step, or the largest adaptive one
+		bool adaptive; //Dormand-Prince 5(4) if true, classic RK4 if not
+		double tolerance; //adaptive error per step, absolute and relative
+		double event_tolerance; //how closely a mode switch is timed
+		double dead_zone; //mode 0 while the state's 1-norm is smaller
+		unsigned int step_budget; //every step tried, rejected and bisection ones too
+
+		//defaults follow the demos' simulate(100, 10, ...)
+		SimulationSettings() : t_final(100.0), dt(10.0), adaptive(true), tolerance(1e-6),
+				       event_tolerance(1e-3), dead_zone(0.01), step_budget(10000) {}
+	};
+
+	template<dim_type D>
+	struct Trajectory {
+		std::vector<double> times;
+		std::vector< std::array<double, D> > states;
+		std::vector<bin_type> modes; //at each sample, held until the next
+		unsigned int steps; //of the budget
+		bool finished; //reached t_final before the budget ran out
+	};
+
+	/*
+		Integrates plant from initial at t=0, querying control (a Fern or
+		CompiledFern) for the mode after every step. When the mode changes
+		within a step, the switch is found by bisecting the step down to
+		event_tolerance, and the new mode starts there. The only limit is
+		step_budget, so a run is the same on every machine.
+	*/
+	template<dim_type D, class Controller>
+	Trajectory<D> simulate(const Plant<D>& plant, const Controller& control,
+			       const typename Plant<D>::state_type& initial,
+			       const SimulationSettings& settings);
+
+	//trapezoid integral of |state| summed over dimensions; a run that ran out
+	//of budget ends with its last state times penalty held at t_final, as in
+	//the demos
+	template<dim_type D>
+	double absolute_error(const Trajectory<D>& trajectory, const double t_final,
+			      const double penalty=1000.0);
+
+	//absolute_error summed over runs from several initial states
+	template<dim_type D, class Controller>
+	double tracking_error(const Plant<D>& plant, const Controller& control,
+			      const std::vector<typename Plant<D>::state_type>& initial,
+			      const SimulationSettings& settings, const double penalty=1000.0);
+
+} //namespace clau
+
+#include "Simulation.cpp"
+
+#endif
@@ -0,0 +1,248 @@
+#ifndef ThresholdFern_cpp
+#define ThresholdFern_cpp
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace clau {
+
+	//=================== ThresholdFern methods ======================
+	inline ThresholdFern::ThresholdFern()
+		: thresholds(1), interval_bins(1, 0), levels(0), num_thresholds(0), 
+		  root_region(), max_bin(0) {}
+
+	inline ThresholdFern::ThresholdFern(const Fern<1>& fern) { compile(fern); }
+
+	inline ThresholdFern::ThresholdFern(const CompiledFern<1>& compiled) { compile(compiled); }
+
+	inline void ThresholdFern::compile(const Fern<1>& fern) {
+		compile( CompiledFern<1>(fern) );
+	}
+
+	inline void ThresholdFern::compile(const CompiledFern<1>& compiled) {
+		typedef CompiledFern<1>::link_type link_type;
+		const CompiledFern<1>::Record* records = compiled.data();
+		root_region = compiled.get_region();
+		max_bin = compiled.get_num_bins() - 1;
+
+		/*
+			An in-order walk gives leaves and boundaries in sorted order,
+			once each boundary is clamped to the interval its ancestors
+			leave open. A clamped boundary splits that interval just as the
+			stored one does, and the clamping keeps the list sorted even
+			when rounding has put a boundary a hair outside its parent's.
+		*/
+		std::vector<num_type> sorted;
+		std::vector<bin_type> ranked;
+		num_type pending = 0.0;
+		auto add_bin = [&sorted, &ranked, &pending](const bin_type bin) {
+			if( ranked.empty() ) ranked.push_back(bin);
+			else if( !sorted.empty() && pending == sorted.back() ) {
+				//the interval before pending is empty, so nothing lands in its bin
+				ranked.back() = bin;
+				if(ranked.size() > 1 && ranked[ranked.size()-2] == bin) {
+					ranked.pop_back();
+					sorted.pop_back();
+				}
+			} else if(bin != ranked.back()) {
+				sorted.push_back(pending);
+				ranked.push_back(bin);
+			}
+		};
+
+		struct Step {
+			link_type link;
+			num_type lower, upper; //open interval, or the threshold itself
+			bool threshold;
+		};
+		const num_type infinity = std::numeric_limits<num_type>::infinity();
+		std::vector<Step> stack;
+		stack.push_back( Step{0, -infinity, infinity, false} );
+		while( !stack.empty() ) {
+			Step step = stack.back();
+			stack.pop_back();
+			if(step.threshold) pending = step.lower;
+			else if( CompiledFern<1>::is_leaf(step.link) )
+				add_bin( CompiledFern<1>::get_bin(step.link) );
+			else {
+				const CompiledFern<1>::Record& fork = records[step.link];
+				num_type boundary = std::min(std::max(fork.boundary, step.lower), step.upper);
+				stack.push_back( Step{fork.child[1], boundary, step.upper, false} );
+				stack.push_back( Step{0, boundary, boundary, true} );
+				stack.push_back( Step{fork.child[0], step.lower, boundary, false} );
+			}
+		}
+
+		//node k at depth d, k-2^d from the left, has in-order rank
+		//(2(k-2^d)+1)*2^(levels-1-d) - 1
+		num_thresholds = sorted.size();
+		levels = 0;
+		while( (std::size_t(1) << levels) - 1 < num_thresholds ) ++levels;
+		const std::size_t full = std::size_t(1) << levels;
+		thresholds.assign(full, infinity);
+		for(unsigned int depth=0; depth<levels; ++depth) {
+			const std::size_t first = std::size_t(1) << depth;
+			for(std::size_t k=first; k<2*first; ++k) {
+				std::size_t rank = ((2*(k-first) + 1) << (levels-1-depth)) - 1;
+				if(rank < num_thresholds) thresholds[k] = sorted[rank];
+			}
+		}
+		interval_bins.assign(full, ranked.back());
+		std::copy(ranked.begin(), ranked.end(), interval_bins.begin());
+	}
+
+	inline bin_type ThresholdFern::query(const num_type x) const {
+		//!(x < threshold) as in Fork::query, so NaN goes right every time
+		const num_type* tree = thresholds.data();
+		std::size_t k = 1;
+		for(unsigned int level=0; level<levels; ++level) k = 2*k + !(x < tree[k]);
+		return interval_bins[k - thresholds.size()];
+	}
+
+	inline void ThresholdFern::query_batch(const num_type* values, const std::size_t count,
+					       bin_type* bins, const unsigned int threads) const {
+		query_batch(bases_type{{values}}, 1, count, bins, threads);
+	}
+
+	inline void ThresholdFern::query_batch(const bases_type& bases, const std::size_t stride,
+					       const std::size_t count, bin_type* bins,
+					       const unsigned int threads,
+					       const kernel_type kernel) const {
+		//value n is bases[0][n*stride]
+		kernel_type chosen = kernel > best_kernel() ? best_kernel() : kernel;
+		if(stride > (1u << 27)) chosen = scalar_kernel; //lane offsets must fit in 32 bits
+
+		const num_type* values = bases[0];
+		parallel_for(count, threads, 4096,
+			[this, values, stride, bins, chosen](std::size_t begin, std::size_t end) {
+				switch(chosen) {
+#ifdef CLAU_X86_KERNELS
+				case avx2_kernel:
+					query_avx2(values + begin*stride, stride, end-begin, bins+begin);
+					break;
+				case sse4_kernel:
+					query_sse4(values + begin*stride, stride, end-begin, bins+begin);
+					break;
+#endif
+				default:
+					query_scalar(values + begin*stride, stride, end-begin, bins+begin);
+				}
+			});
+	}
+
+	inline std::vector<num_type> ThresholdFern::get_thresholds() const {
+		//the padding sorts last, after the first num_thresholds ranks
+		std::vector<num_type> sorted(num_thresholds);
+		for(unsigned int depth=0; depth<levels; ++depth) {
+			const std::size_t first = std::size_t(1) << depth;
+			for(std::size_t k=first; k<2*first; ++k) {
+				std::size_t rank = ((2*(k-first) + 1) << (levels-1-depth)) - 1;
+				if(rank < num_thresholds) sorted[rank] = thresholds[k];
+			}
+		}
+		return sorted;
+	}
+
+	inline std::vector<bin_type> ThresholdFern::get_bins() const {
+		return std::vector<bin_type>(interval_bins.begin(), interval_bins.begin() + num_thresholds + 1);
+	}
+
+	inline void ThresholdFern::query_scalar(const num_type* values, const std::size_t stride,
+						const std::size_t count, bin_type* out) const {
+		//successive values don't depend on each other, so their searches overlap
+		const num_type* tree = thresholds.data();
+		const std::size_t full = thresholds.size();
+		for(std::size_t n=0; n<count; ++n) {
+			const num_type x = values[n*stride];
+			std::size_t k = 1;
+			for(unsigned int level=0; level<levels; ++level) k = 2*k + !(x < tree[k]);
+			out[n] = interval_bins[k - full];
+		}
+	}
+
+#ifdef CLAU_X86_KERNELS
+	__attribute__((target("sse4.1")))
+	inline void ThresholdFern::query_sse4(const num_type* values, const std::size_t stride,
+					      const std::size_t count, bin_type* out) const {
+		//four values descend in lockstep; without a gather, thresholds are loaded by hand
+		const num_type* tree = thresholds.data();
+		const std::int32_t full = thresholds.size();
+		alignas(16) std::int32_t k[4];
+
+		std::size_t n = 0;
+		for(; n+4 <= count; n+=4) {
+			__m128 x = _mm_setr_ps(values[n*stride], values[(n+1)*stride],
+					       values[(n+2)*stride], values[(n+3)*stride]);
+			__m128i links = _mm_set1_epi32(1);
+			for(unsigned int level=0; level<levels; ++level) {
+				_mm_store_si128(reinterpret_cast<__m128i*>(k), links);
+				__m128 threshold = _mm_setr_ps(tree[k[0]], tree[k[1]], tree[k[2]], tree[k[3]]);
+				//!(x < threshold) is all ones, so subtracting it adds one
+				__m128i right = _mm_castps_si128(_mm_cmpnlt_ps(x, threshold));
+				links = _mm_sub_epi32(_mm_add_epi32(links, links), right);
+			}
+			_mm_store_si128(reinterpret_cast<__m128i*>(k), links);
+			for(int lane=0; lane<4; ++lane) out[n+lane] = interval_bins[k[lane] - full];
+		}
+
+		query_scalar(values + n*stride, stride, count-n, out+n);
+	}
+
+	__attribute__((target("avx2")))
+	inline void ThresholdFern::query_avx2(const num_type* values, const std::size_t stride,
+					      const std::size_t count, bin_type* out) const {
+		/*
+			Eight values descend in lockstep and every lane takes exactly
+			levels steps, so there are no masks: each step is one gather,
+			one compare and a shift. The top of the tree is the same for
+			every lane and stays in L1.
+		*/
+		const float* tree = thresholds.data();
+		const std::int32_t full = thresholds.size();
+		const __m256i lanes = _mm256_mullo_epi32( _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+		                                          _mm256_set1_epi32(static_cast<int>(stride)) );
+		alignas(32) std::int32_t k[8];
+
+		std::size_t n = 0;
+		for(; n+8 <= count; n+=8) {
+			__m256 x = stride == 1 ? _mm256_loadu_ps(values + n) :
+			           _mm256_i32gather_ps(values + n*stride, lanes, 4);
+			__m256i links = _mm256_set1_epi32(1);
+			for(unsigned int level=0; level<levels; ++level) {
+				__m256 threshold = _mm256_i32gather_ps(tree, links, 4);
+				//!(x < threshold), true for NaN like the scalar path
+				__m256i right = _mm256_castps_si256(_mm256_cmp_ps(x, threshold, _CMP_NLT_UQ));
+				links = _mm256_sub_epi32(_mm256_add_epi32(links, links), right);
+			}
+			_mm256_store_si256(reinterpret_cast<__m256i*>(k), links);
+			for(int lane=0; lane<8; ++lane) out[n+lane] = interval_bins[k[lane] - full];
+		}
+
+		query_scalar(values + n*stride, stride, count-n, out+n);
+	}
+#endif
+
+} //namespace clau
+
+#endif
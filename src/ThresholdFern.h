@@ -0,0 +1,99 @@
+#ifndef ThresholdFern_h
+#define ThresholdFern_h
+
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+#include <cstddef>
+#include <vector>
+#include "Fern.h"
+#include "CompiledFern.h"
+
+namespace clau {
+
+	class ThresholdFern {
+	/*
+		A ThresholdFern is a read-only snapshot of a 1D Fern flattened into
+		what it really is: sorted thresholds with a bin for every interval
+		between them, neighbours in the same bin merged. The thresholds are
+		stored in Eytzinger order, the breadth-first layout of a complete
+		search tree, padded with +inf until the tree is full. Every query
+		then takes the same number of steps, each a compare and a shift
+		with no branch to mispredict. Answers match Fern::query exactly,
+		NaNs included. Call compile() again after the source Fern changes.
+	*/
+	public:
+		typedef CompiledFern<1>::bases_type bases_type; //strided values
+
+	private:
+		std::vector<num_type> thresholds; //implicit tree from index 1; 0 is unused
+		std::vector<bin_type> interval_bins; //by rank, the padding in the last bin
+		unsigned int levels; //thresholds.size() is 2^levels
+		std::size_t num_thresholds; //before padding
+		Region<1> root_region;
+		bin_type max_bin;
+
+	public:
+		ThresholdFern();
+		explicit ThresholdFern(const Fern<1>& fern);
+		explicit ThresholdFern(const CompiledFern<1>& compiled);
+		ThresholdFern(const ThresholdFern& rhs) = default;
+		ThresholdFern& operator=(const ThresholdFern& rhs) = default;
+		~ThresholdFern() = default;
+
+		void compile(const Fern<1>& fern);
+		void compile(const CompiledFern<1>& compiled);
+
+		bin_type query(const Point<1>& point) const { return query(point(1)); }
+		bin_type query(const num_type x) const;
+
+		//same layouts as CompiledFern<1>::query_batch
+		void query_batch(const num_type* values, const std::size_t count,
+		                 bin_type* bins, const unsigned int threads=1) const;
+		void query_batch(const bases_type& bases, const std::size_t stride,
+		                 const std::size_t count, bin_type* bins,
+		                 const unsigned int threads=1,
+		                 const kernel_type kernel=best_kernel()) const; //strided
+
+		Region<1> get_region() const { return root_region; }
+		bin_type get_num_bins() const { return max_bin+1; }
+		std::size_t size() const { return num_thresholds; } //thresholds, one less than intervals
+
+		//sorted thresholds and the bin of each interval, for inspection
+		std::vector<num_type> get_thresholds() const;
+		std::vector<bin_type> get_bins() const;
+
+	private:
+		//each kernel answers count values, the first of which is at values[0]
+		void query_scalar(const num_type* values, const std::size_t stride,
+		                  const std::size_t count, bin_type* out) const;
+#ifdef CLAU_X86_KERNELS
+		void query_sse4(const num_type* values, const std::size_t stride,
+		                const std::size_t count, bin_type* out) const;
+		void query_avx2(const num_type* values, const std::size_t stride,
+		                const std::size_t count, bin_type* out) const;
+#endif
+	}; //class ThresholdFern
+
+} //namespace clau
+
+#include "ThresholdFern.cpp"
+
+#endif
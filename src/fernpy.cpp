@@ -20,7 +20,16 @@
 
 #include <boost/python.hpp>
 #include <string>
+#include <cstring>
+#include <limits>
 #include "Fern.h"
+#include "CompiledFern.h"
+#include "Population.h"
+#include "Accuracy.h"
+#include "Simulation.h"
+#include "MappedFern.h"
+#include "PopulationFile.h"
+#include "ThresholdFern.h"
 
 /*
 #define PYTHON_ERROR(TYPE, REASON) \
@@ -96,91 +105,707 @@ struct std_pickle : boost::python::pickle_suite { //helper class for pickling
 	}
 };
 
+namespace clau { //Fern befriends clau::fern_pickle
+
 template<clau::dim_type D>
 struct fern_pickle : boost::python::pickle_suite {
-	static boost::python::tuple savenode(typename clau::Fern<D>::Fork* fork_ptr) { //clau::Fern<D>::Fork not recognized as type?
+	/*
+		The state is Fern's binary format as one bytes object, written and
+		read in C++ without a python object per node. Older pickles hold
+		nested tuples instead; setstate tells them apart by type and still 
+		reads them, without recursing.
+	*/
+	typedef typename clau::Fern<D>::link_type link_type;
+
+	static link_type constructtree(clau::Fern<D>& fern, boost::python::tuple root) {
+		//(true, bin) for a leaf, (false, division, left, right) for a fork; 
+		//builds in fern's pool, leaving its root alone, and throws on bad input
 		using namespace clau;
-		namespace bp = boost::python; //needed to tell between std::tuple and bp::tuple
-		
-		//save division in this node
-		auto divisionstr = fork_ptr->value.save();
-		
-		//save left subtree
-		bp::tuple lefttuple;
-		if( fork_ptr->left->leaf )
-			lefttuple = bp::make_tuple(true, static_cast<typename Fern<D>::Leaf*>(fork_ptr->left)->bin);
-		else 	lefttuple = savenode( static_cast<typename Fern<D>::Fork*>(fork_ptr->left) );
+		using namespace boost::python;
 		
-		//save right subtree
-		bp::tuple righttuple;
-		if( fork_ptr->right->leaf )
-			righttuple = bp::make_tuple(true, static_cast<typename Fern<D>::Leaf*>(fork_ptr->right)->bin);
-		else	righttuple = savenode( static_cast<typename Fern<D>::Fork*>(fork_ptr->right) );
+		struct pending { tuple state; link_type parent; int side; };
+		std::vector<pending> stack(1, pending{root, 0, -1});
+		std::vector<link_type> created; //forks in preorder
+		link_type top = 0;
+		while( !stack.empty() ) {
+			pending next = stack.back();
+			stack.pop_back();
 			
-		return bp::make_tuple(false, divisionstr, lefttuple, righttuple);
+			link_type link;
+			if( extract<bool>(next.state[0]) ) {
+				bin_type bin = extract<bin_type>(next.state[1]);
+				if(bin > fern.max_bin || next.side < 0) invalid();
+				link = Fern<D>::leaf_link(bin);
+			} else {
+				Division<D> division;
+				std::string divisionstr = extract<std::string>(next.state[1]);
+				division.load(divisionstr);
+				if(division.dimension < 1 || division.dimension > D) invalid();
+				link = fern.forks->create(division);
+				created.push_back(link);
+				stack.push_back( pending{extract<tuple>(next.state[3]), link, 1} );
+				stack.push_back( pending{extract<tuple>(next.state[2]), link, 0} );
+			}
+			//creating nodes may move the pool, so index again each time
+			if(next.side < 0) top = link;
+			else if(next.side == 0) fern.fork_at(next.parent).left = link;
+			else fern.fork_at(next.parent).right = link;
+		}
+		
+		//children come after their parents, so sizes fill in back to front
+		for(auto fork = created.rbegin(); fork != created.rend(); ++fork) {
+			auto& node = fern.fork_at(*fork);
+			node.size = 1 + fern.subtree_size(node.left) + fern.subtree_size(node.right);
+		}
+		return top;
 	}
 	
-	static typename clau::Fern<D>::Fork* constructnode(typename clau::Fern<D>::Fork* parent_ptr, boost::python::tuple state) {
-		using namespace clau;
+	static void invalid() {
+		PyErr_SetString(PyExc_ValueError, "not a saved Fern of this dimension");
+		boost::python::throw_error_already_set();
+	}
+	
+	static boost::python::tuple getinitargs(const clau::Fern<D>& x) {
+		return boost::python::make_tuple();
+	}
+	
+	static boost::python::object getstate(const clau::Fern<D>& x) {
+		std::string data = x.save_binary();
+		return boost::python::object( boost::python::handle<>( 
+			PyBytes_FromStringAndSize(data.data(), data.size()) ) );
+	}
+	
+	static void setstate(clau::Fern<D>& x, boost::python::object state) {
 		using namespace boost::python;
 		
-		//load division for this node
-		Division<D> division;
-		std::string divisionstr = extract<std::string>(state[1]);
-		division.load(divisionstr);
+		if( PyBytes_Check(state.ptr()) ) {
+			if( !x.load_binary(PyBytes_AS_STRING(state.ptr()), PyBytes_GET_SIZE(state.ptr())) ) 
+				invalid();
+			return;
+		}
 		
-		auto fork_ptr = new typename Fern<D>::Fork(parent_ptr, division);
+		//built aside and swapped in only once it all reads, like load_binary
+		tuple old = extract<tuple>(state);
+		clau::Fern<D> built;
+		std::string regionstr = extract<std::string>(old[0]);
+		built.root_region.load(regionstr);
+		built.max_bin = extract<clau::bin_type>(old[1]);
+		built.node_type_chance = extract<float>(old[2]);
+		built.mutation_type_chance_fork = extract<float>(old[3]);
+		built.mutation_type_chance_leaf = extract<float>(old[4]);
 		
-		//reconstruct left subtree
-		tuple lefttuple = extract<tuple>(state[2]);
-		if( extract<bool>(lefttuple[0]) ) {
-			bin_type leftbin = extract<bin_type>(lefttuple[1]);
-			fork_ptr->left = new typename Fern<D>::Leaf(fork_ptr, leftbin);
-		} else fork_ptr->left = constructnode(fork_ptr, lefttuple);
+		link_type top = constructtree(built, extract<tuple>(old[5]));
+		built.release(built.root);
+		built.root = top;
+		built.update_boundary();
+		built.generator = x.generator;
+		built.grid = clau::Fern<D>::copy_grid(x.grid);
+		x.swap(built); //built lets go of the old tree, leaving any sharers alone
+	}
+};
+
+} //namespace clau
+
+struct py_buffer { //holds a buffer-protocol view for as long as it's in scope
+	Py_buffer view;
+	
+	py_buffer(PyObject* exporter, const int flags) {
+		if( PyObject_GetBuffer(exporter, &view, flags) != 0 ) 
+			boost::python::throw_error_already_set();
+	}
+	~py_buffer() { PyBuffer_Release(&view); }
+	
+	char type() const { //struct-module code with byte order stripped, or 0 if foreign
+		const char* format = view.format ? view.format : "B";
+		if( *format=='@' || *format=='=' || *format=='<' ) ++format;
+		return std::strlen(format)==1 ? *format : 0;
+	}
+};
+
+struct release_gil { //lets other python threads run while C++ works
+	PyThreadState* state;
+	release_gil() : state( PyEval_SaveThread() ) {}
+	~release_gil() { PyEval_RestoreThread(state); }
+};
+
+template<clau::dim_type D>
+struct py_points { //an (N,D) array of points as CompiledFern's strided layout
+	/*
+		float32 with sane strides is read in place; anything else is 
+		converted once. A flat array of N values is accepted when D==1.
+	*/
+	py_buffer input;
+	std::vector<clau::num_type> converted;
+	typename clau::CompiledFern<D>::bases_type bases;
+	std::size_t stride, count;
+	
+	explicit py_points(boost::python::object points) 
+		: input(points.ptr(), PyBUF_STRIDES | PyBUF_FORMAT) {
+		namespace bp = boost::python;
 		
-		//reconstruct right subtree
-		tuple righttuple = extract<tuple>(state[3]);
-		if( extract<bool>(righttuple[0]) ) {
-			bin_type rightbin = extract<bin_type>(righttuple[1]);
-			fork_ptr->right = new typename Fern<D>::Leaf(fork_ptr, rightbin);
-		} else fork_ptr->right = constructnode(fork_ptr, righttuple);
+		const Py_buffer& view = input.view;
+		char type = input.type();
+		if( !((type=='f' && view.itemsize==4) || (type=='d' && view.itemsize==8)) ) {
+			PyErr_SetString(PyExc_TypeError, "points must be float32 or float64");
+			bp::throw_error_already_set();
+		}
+		if( !(view.ndim==2 && view.shape[1]==D) && !(view.ndim==1 && D==1) ) {
+			PyErr_SetString(PyExc_ValueError, "points must have shape (N, D)");
+			bp::throw_error_already_set();
+		}
+		count = view.shape[0];
+		const Py_ssize_t row_stride = view.strides[0];
+		const Py_ssize_t column_stride = view.ndim==2 ? view.strides[1] : view.itemsize;
+		const char* buffer = static_cast<const char*>(view.buf);
 		
-		return fork_ptr;
+		if( type=='f' && row_stride>=0 && column_stride>=0 && 
+		    row_stride%4==0 && column_stride%4==0 ) {
+			for(int i=0; i<D; ++i) bases[i] = reinterpret_cast<const clau::num_type*>(
+				buffer + i*column_stride);
+			stride = row_stride/4;
+			return;
+		}
+		converted.resize(count*D);
+		for(std::size_t n=0; n<count; ++n) {
+			const char* row = buffer + Py_ssize_t(n)*row_stride;
+			for(int i=0; i<D; ++i) {
+				const char* item = row + i*column_stride;
+				converted[n*D + i] = type=='f' ? *reinterpret_cast<const float*>(item) : 
+								 *reinterpret_cast<const double*>(item);
+			}
+		}
+		for(int i=0; i<D; ++i) bases[i] = converted.data() + i;
+		stride = D;
+	}
+};
+
+template<class T>
+std::vector<T> py_column(boost::python::object values, const std::size_t count, 
+			 const bool integral) {
+	/*
+		Copies a 1D array of count numbers into a vector of T. Labels take 
+		any integer or bool type, and ones that no bin could match become 
+		the largest bin_type. Weights take float32 or float64.
+	*/
+	namespace bp = boost::python;
+	py_buffer input(values.ptr(), PyBUF_STRIDES | PyBUF_FORMAT);
+	const Py_buffer& view = input.view;
+	if(view.ndim != 1 || std::size_t(view.shape[0]) != count) {
+		PyErr_SetString(PyExc_ValueError, "expected one value per point");
+		bp::throw_error_already_set();
+	}
+	char type = input.type();
+	bool is_signed = std::strchr("bhilq", type) != nullptr;
+	bool is_integral = type=='?' || (type!=0 && std::strchr("bBhHiIlLqQ", type) != nullptr);
+	bool is_float = (type=='f' && view.itemsize==4) || (type=='d' && view.itemsize==8);
+	if(integral ? !is_integral : !is_float) {
+		PyErr_SetString(PyExc_TypeError, integral ? "labels must be integers" : 
+							    "weights must be float32 or float64");
+		bp::throw_error_already_set();
 	}
 	
-	static boost::python::tuple getinitargs(const clau::Fern<D>& x) {
-		return boost::python::make_tuple();
+	std::vector<T> column(count);
+	const char* buffer = static_cast<const char*>(view.buf);
+	for(std::size_t n=0; n<count; ++n) {
+		const char* item = buffer + Py_ssize_t(n)*view.strides[0];
+		if(!integral) {
+			column[n] = type=='f' ? *reinterpret_cast<const float*>(item) : 
+						*reinterpret_cast<const double*>(item);
+			continue;
+		}
+		std::int64_t value = 0; //little-endian sign or zero extension
+		std::memcpy(&value, item, view.itemsize);
+		if( is_signed && view.itemsize < 8 && (value >> (8*view.itemsize-1)) ) 
+			value -= std::int64_t(1) << (8*view.itemsize);
+		const std::int64_t none = std::numeric_limits<clau::bin_type>::max();
+		column[n] = (value < 0 || value > none) ? none : value;
+	}
+	return column;
+}
+
+template<clau::dim_type D>
+struct fern_array { //NumPy entry points for Fern
+	static boost::python::object query_array(const clau::Fern<D>& fern, 
+						 boost::python::object points, 
+						 const unsigned int threads) {
+		/*
+			Reads an (N,D) float32 or float64 array (or a flat array of N 
+			values when D==1) through the buffer protocol and returns N bins
+			as a uint16 NumPy array. The GIL is released while querying. 
+		*/
+		using namespace clau;
+		namespace bp = boost::python;
+		
+		py_points<D> input(points);
+		bp::object numpy = bp::import("numpy");
+		bp::object bins = numpy.attr("empty")(input.count, bp::object(numpy.attr("uint16")));
+		py_buffer output(bins.ptr(), PyBUF_CONTIG);
+		bin_type* out = static_cast<bin_type*>(output.view.buf);
+		
+		//snapshot taken with the GIL held, so nobody can be mutating the Fern
+		CompiledFern<D> compiled(fern);
+		{ //the GIL is back before any python object is touched again
+			release_gil unlocked;
+			compiled.query_batch(input.bases, input.stride, input.count, out, threads);
+		}
+		return bins;
+	}
+	
+	static boost::python::tuple leaves(const clau::Fern<D>& fern) {
+		//(lower, upper, bins): (L,D) float32 bounds and L uint16 bins, left to right
+		namespace bp = boost::python;
+		const std::size_t count = fern.get_num_leaves();
+		bp::object numpy = bp::import("numpy");
+		bp::object float32 = numpy.attr("float32");
+		bp::object lower = numpy.attr("empty")(bp::make_tuple(count, D), float32);
+		bp::object upper = numpy.attr("empty")(bp::make_tuple(count, D), float32);
+		bp::object bins = numpy.attr("empty")(count, bp::object(numpy.attr("uint16")));
+		py_buffer lower_view(lower.ptr(), PyBUF_CONTIG), upper_view(upper.ptr(), PyBUF_CONTIG);
+		py_buffer bin_view(bins.ptr(), PyBUF_CONTIG);
+		clau::num_type* low = static_cast<clau::num_type*>(lower_view.view.buf);
+		clau::num_type* high = static_cast<clau::num_type*>(upper_view.view.buf);
+		clau::bin_type* bin = static_cast<clau::bin_type*>(bin_view.view.buf);
+		for(auto& leaf : fern.leaves()) {
+			for(int i=1; i<=D; ++i) {
+				*low++ = leaf.region(i).lower;
+				*high++ = leaf.region(i).upper;
+			}
+			*bin++ = leaf.bin;
+		}
+		return bp::make_tuple(lower, upper, bins);
 	}
 	
-	static boost::python::tuple getstate(const clau::Fern<D>& x) {
-		auto regionstr = x.root_region.save();
-		auto binnum = x.max_bin;
-		auto nchance = x.node_type_chance;
-		auto mchancef = x.mutation_type_chance_fork;
-		auto mchancel = x.mutation_type_chance_leaf;
-		auto roottuple = savenode(x.root);
+	static boost::python::object rasterize(const clau::Fern<D>& fern, 
+					       const clau::Region<D>& window, 
+					       const std::size_t width, const std::size_t height, 
+					       const unsigned int threads) {
+		/*
+			Returns the bins at the pixel centers of window as a (height,
+			width) uint16 array, row 0 at the lower bound of dimension 2. 
+			The walk is over the Fern itself, so the GIL stays held; a map 
+			takes milliseconds.
+		*/
+		namespace bp = boost::python;
+		bp::object numpy = bp::import("numpy");
+		bp::object grid = numpy.attr("empty")(bp::make_tuple(height, width), 
+						      bp::object(numpy.attr("uint16")));
+		py_buffer output(grid.ptr(), PyBUF_CONTIG);
+		fern.rasterize(window, width, height, static_cast<clau::bin_type*>(output.view.buf), 
+			       threads);
+		return grid;
+	}
+	
+	//classification scores against an array of N integer labels, as in Accuracy.h
+	static double accuracy(const clau::Fern<D>& fern, boost::python::object points, 
+			       boost::python::object labels, const unsigned int threads) {
+		py_points<D> input(points);
+		auto label = py_column<clau::bin_type>(labels, input.count, true);
+		clau::CompiledFern<D> compiled(fern);
+		release_gil unlocked;
+		return clau::accuracy(compiled, input.bases, input.stride, input.count, 
+				      label.data(), threads);
+	}
+	
+	static double weighted_accuracy(const clau::Fern<D>& fern, boost::python::object points, 
+					boost::python::object labels, 
+					boost::python::object weights, const unsigned int threads) {
+		py_points<D> input(points);
+		auto label = py_column<clau::bin_type>(labels, input.count, true);
+		auto weight = py_column<clau::num_type>(weights, input.count, false);
+		clau::CompiledFern<D> compiled(fern);
+		release_gil unlocked;
+		return clau::weighted_accuracy(compiled, input.bases, input.stride, input.count, 
+					       label.data(), weight.data(), threads);
+	}
+	
+	static boost::python::object confusion_matrix(const clau::Fern<D>& fern, 
+						      boost::python::object points, 
+						      boost::python::object labels, 
+						      const unsigned int threads) {
+		//a (bins, bins) uint64 array, rows by label and columns by bin
+		namespace bp = boost::python;
+		py_points<D> input(points);
+		auto label = py_column<clau::bin_type>(labels, input.count, true);
+		clau::CompiledFern<D> compiled(fern);
+		std::vector<std::size_t> matrix;
+		{
+			release_gil unlocked;
+			matrix = clau::confusion_matrix(compiled, input.bases, input.stride, 
+							input.count, label.data(), threads);
+		}
+		const std::size_t bins = compiled.get_num_bins();
+		bp::object numpy = bp::import("numpy");
+		bp::object result = numpy.attr("zeros")(bp::make_tuple(bins, bins), 
+							 bp::object(numpy.attr("uint64")));
+		py_buffer output(result.ptr(), PyBUF_CONTIG);
+		std::copy(matrix.begin(), matrix.end(), static_cast<std::uint64_t*>(output.view.buf));
+		return result;
+	}
+};
 
-		return boost::python::make_tuple(regionstr, binnum, nchance, 
-						 mchancef, mchancel, roottuple);
+struct hold_gil { //lets a C++ thread call into python
+	PyGILState_STATE state;
+	hold_gil() : state( PyGILState_Ensure() ) {}
+	~hold_gil() { PyGILState_Release(state); }
+};
+
+struct python_error { //a python exception carried out of a worker thread
+	PyObject *type, *value, *traceback; //owned until restored
+	python_error() { PyErr_Fetch(&type, &value, &traceback); } //GIL held
+	python_error(python_error&& rhs) noexcept 
+		: type(rhs.type), value(rhs.value), traceback(rhs.traceback) {
+		rhs.type = rhs.value = rhs.traceback = nullptr;
+	}
+	python_error(const python_error&) = delete;
+	python_error& operator=(const python_error&) = delete;
+	~python_error() { 
+		//errors dropped unreported, like all but the first from work_stealing_for
+		if(type || value || traceback) {
+			hold_gil locked;
+			Py_XDECREF(type);
+			Py_XDECREF(value);
+			Py_XDECREF(traceback);
+		}
+	}
+	void restore() { //GIL held; hands the references back to python
+		PyErr_Restore(type, value, traceback);
+		type = value = traceback = nullptr;
 	}
+};
+
+template<class Function>
+void without_gil(Function fn) {
+	//python callbacks take the GIL back per call and report errors as 
+	//python_error, which is turned back into a python exception here
+	try {
+		release_gil unlocked;
+		fn();
+	} catch(python_error& error) {
+		error.restore();
+		boost::python::throw_error_already_set();
+	}
+}
+
+template<clau::dim_type D>
+struct population_py { //Python entry points for Population
+	typedef clau::Population<D> population_type;
 	
-	static void setstate(clau::Fern<D>& x, boost::python::tuple state) {
-		using namespace boost::python;
-		
-		std::string regionstr = extract<std::string>(state[0]);
-		x.root_region.load(regionstr);
-		x.max_bin = extract<clau::bin_type>(state[1]);
-		x.node_type_chance = extract<float>(state[2]);
-		x.mutation_type_chance_fork = extract<float>(state[3]);
-		x.mutation_type_chance_leaf = extract<float>(state[4]);
+	static clau::Fern<D> detached(const clau::Fern<D>& fern) {
+		//breeding runs without the GIL and grows the members' pool, so no Fern
+		//python can reach may share it; every Fern in or out gets its own pool
+		clau::Fern<D> copy(fern);
+		copy.compact();
+		return copy;
+	}
+	
+	static typename population_type::fitness_type wrap(boost::python::object callable) {
+		//members are lent for the call only; fitness must copy one it wants to keep
+		return [callable](const clau::Fern<D>& fern) { 
+			hold_gil locked;
+			try {
+				return boost::python::extract<double>( callable(boost::ref(fern)) )(); 
+			} catch(const boost::python::error_already_set&) {
+				throw python_error();
+			}
+		};
+	}
+	
+	static void evaluate(population_type& x) { without_gil([&x]() { x.evaluate(); }); }
+	static void breed(population_type& x) { without_gil([&x]() { x.breed(); }); }
+	static void run(population_type& x, const unsigned int generations) { 
+		without_gil([&x, generations]() { x.run(generations); }); 
+	}
+	static std::size_t best(population_type& x) {
+		std::size_t index = 0;
+		without_gil([&x, &index]() { index = x.best(); });
+		return index;
+	}
+	
+	static std::shared_ptr<population_type> from_ancestor(const clau::Fern<D>& ancestor, 
+							      const std::size_t size, 
+							      boost::python::object fitness) {
+		return std::make_shared<population_type>(detached(ancestor), size, wrap(fitness));
+	}
+	
+	static std::shared_ptr<population_type> from_list(boost::python::object founders, 
+							  boost::python::object fitness) {
+		std::vector< clau::Fern<D> > members;
+		for(int i=0, n=boost::python::len(founders); i<n; ++i) 
+			members.push_back( detached(boost::python::extract<const clau::Fern<D>&>(founders[i])) );
+		return std::make_shared<population_type>(members, wrap(fitness));
+	}
+	
+	static void set_fitness(population_type& x, boost::python::object fitness) {
+		x.set_fitness( wrap(fitness) );
+	}
+	
+	static clau::Fern<D> get(const population_type& x, int i) {
+		if( i<0 ) i += x.size();
+		if( i>=0 && i<int(x.size()) ) return detached(x[i]);
+		IndexError();
+		boost::python::throw_error_already_set();
+		return clau::Fern<D>();
+	}
+	
+	static void set(population_type& x, int i, const clau::Fern<D>& member) {
+		if( i<0 ) i += x.size();
+		if( i>=0 && i<int(x.size()) ) x.set_member(i, detached(member));
+		else {
+			IndexError();
+			boost::python::throw_error_already_set();
+		}
+	}
+	
+	static boost::python::list fitness(population_type& x) {
+		without_gil([&x]() { x.get_fitness(); });
+		boost::python::list scores;
+		for(double score : x.get_fitness()) scores.append(score);
+		return scores;
+	}
+	
+	static boost::python::list timings(const population_type& x) { //seconds per member
+		boost::python::list seconds;
+		for(double time : x.get_timings()) seconds.append(time);
+		return seconds;
+	}
+};
+
+template<clau::dim_type D>
+struct simulation_py { //Python entry points for Simulation.h
+	typedef typename clau::Plant<D>::state_type state_type;
+	
+	static state_type to_state(boost::python::object sequence) {
+		namespace bp = boost::python;
+		if(bp::len(sequence) != D) {
+			PyErr_SetString(PyExc_ValueError, "a state needs one value per dimension");
+			bp::throw_error_already_set();
+		}
+		state_type state;
+		for(int i=0; i<D; ++i) state[i] = bp::extract<double>(sequence[i]);
+		return state;
+	}
+	
+	static std::shared_ptr< clau::Plant<D> > from_callable(boost::python::object dynamics) {
+		//dynamics(state, mode) returns the derivative as a sequence; it may be 
+		//called without the GIL held, so it takes it back itself
+		return std::make_shared< clau::Plant<D> >( 
+			[dynamics](const state_type& state, const clau::bin_type mode) {
+				hold_gil locked;
+				try {
+					boost::python::list values;
+					for(int i=0; i<D; ++i) values.append(state[i]);
+					return to_state( dynamics(values, mode) );
+				} catch(const boost::python::error_already_set&) {
+					throw python_error();
+				}
+			});
+	}
+	
+	static boost::python::tuple simulate(const clau::Fern<D>& fern, const clau::Plant<D>& plant, 
+					     boost::python::object initial, 
+					     const clau::SimulationSettings& settings) {
+		//(times, states, finished), with states an (N,D) float64 array
+		namespace bp = boost::python;
+		state_type start = to_state(initial);
+		clau::CompiledFern<D> compiled(fern);
+		clau::Trajectory<D> trajectory;
+		without_gil([&]() { trajectory = clau::simulate(plant, compiled, start, settings); });
 		
-		delete x.root;
-		tuple roottuple = extract<tuple>(state[5]);
-		x.root = constructnode(nullptr, roottuple);
-		x.update_boundary();
+		bp::object numpy = bp::import("numpy");
+		bp::object float64 = numpy.attr("float64");
+		const std::size_t count = trajectory.times.size();
+		bp::object times = numpy.attr("empty")(count, float64);
+		bp::object states = numpy.attr("empty")(bp::make_tuple(count, D), float64);
+		py_buffer time_view(times.ptr(), PyBUF_CONTIG), state_view(states.ptr(), PyBUF_CONTIG);
+		std::copy(trajectory.times.begin(), trajectory.times.end(), 
+			  static_cast<double*>(time_view.view.buf));
+		double* out = static_cast<double*>(state_view.view.buf);
+		for(const state_type& state : trajectory.states) out = std::copy(state.begin(), state.end(), out);
+		return bp::make_tuple(times, states, trajectory.finished);
+	}
+	
+	static double tracking_error(const clau::Fern<D>& fern, const clau::Plant<D>& plant, 
+				     boost::python::object initial, 
+				     const clau::SimulationSettings& settings, const double penalty) {
+		std::vector<state_type> starts;
+		for(int n=0, count=boost::python::len(initial); n<count; ++n) 
+			starts.push_back( to_state(initial[n]) );
+		clau::CompiledFern<D> compiled(fern);
+		double error = 0.0;
+		without_gil([&]() { 
+			error = clau::tracking_error(plant, compiled, starts, settings, penalty); 
+		});
+		return error;
+	}
+};
+
+template<clau::dim_type D>
+struct mapped_py { //Python entry points for MappedFern
+	static std::shared_ptr< clau::MappedFern<D> > from_path(const std::string& path) {
+		auto mapped = std::make_shared< clau::MappedFern<D> >(path);
+		if( !mapped->is_open() ) {
+			PyErr_SetString(PyExc_IOError, ("not a model file: " + path).c_str());
+			boost::python::throw_error_already_set();
+		}
+		return mapped;
+	}
+	
+	static bool save(const clau::Fern<D>& fern, const std::string& path) {
+		return clau::MappedFern<D>::write(fern, path);
+	}
+	
+	static boost::python::object query_array(const clau::MappedFern<D>& mapped, 
+						 boost::python::object points, 
+						 const unsigned int threads) {
+		//as fern_array::query_array, without the snapshot
+		namespace bp = boost::python;
+		py_points<D> input(points);
+		bp::object numpy = bp::import("numpy");
+		bp::object bins = numpy.attr("empty")(input.count, bp::object(numpy.attr("uint16")));
+		py_buffer output(bins.ptr(), PyBUF_CONTIG);
+		clau::bin_type* out = static_cast<clau::bin_type*>(output.view.buf);
+		{
+			release_gil unlocked;
+			mapped.query_batch(input.bases, input.stride, input.count, out, threads);
+		}
+		return bins;
 	}
 };
 
+struct threshold_py { //Python entry points for ThresholdFern
+	static boost::python::object query_array(const clau::ThresholdFern& flat, 
+						 boost::python::object points, 
+						 const unsigned int threads) {
+		//as fern_array::query_array; a ThresholdFern is already a snapshot
+		namespace bp = boost::python;
+		py_points<1> input(points);
+		bp::object numpy = bp::import("numpy");
+		bp::object bins = numpy.attr("empty")(input.count, bp::object(numpy.attr("uint16")));
+		py_buffer output(bins.ptr(), PyBUF_CONTIG);
+		clau::bin_type* out = static_cast<clau::bin_type*>(output.view.buf);
+		{
+			release_gil unlocked;
+			flat.query_batch(input.bases, input.stride, input.count, out, threads);
+		}
+		return bins;
+	}
+	
+	static boost::python::tuple thresholds(const clau::ThresholdFern& flat) {
+		//(thresholds, bins): T sorted float32 thresholds and T+1 uint16 bins
+		namespace bp = boost::python;
+		std::vector<clau::num_type> sorted = flat.get_thresholds();
+		std::vector<clau::bin_type> ranked = flat.get_bins();
+		bp::object numpy = bp::import("numpy");
+		bp::object values = numpy.attr("empty")(sorted.size(), bp::object(numpy.attr("float32")));
+		bp::object bins = numpy.attr("empty")(ranked.size(), bp::object(numpy.attr("uint16")));
+		py_buffer value_view(values.ptr(), PyBUF_CONTIG), bin_view(bins.ptr(), PyBUF_CONTIG);
+		std::copy(sorted.begin(), sorted.end(), static_cast<clau::num_type*>(value_view.view.buf));
+		std::copy(ranked.begin(), ranked.end(), static_cast<clau::bin_type*>(bin_view.view.buf));
+		return bp::make_tuple(values, bins);
+	}
+};
+
+template<clau::dim_type D>
+struct population_file_py { //Python entry points for PopulationFile.h
+	typedef clau::PopulationFile<D> file_type;
+	
+	static bool save(const std::string& path, boost::python::list ferns, 
+			 boost::python::object fitness, const unsigned int threads) {
+		//other python threads may change the Ferns, or their shared pools, 
+		//so they are serialized with the GIL held; only the write goes without
+		namespace bp = boost::python;
+		std::vector<const clau::Fern<D>*> members;
+		for(int n=0, count=bp::len(ferns); n<count; ++n) 
+			members.push_back( &bp::extract<const clau::Fern<D>&>(ferns[n])() );
+		bp::object numpy = bp::import("numpy");
+		auto scores = py_column<double>( numpy.attr("asarray")(fitness, 
+			bp::object(numpy.attr("float64"))), members.size(), false );
+		std::vector<std::string> blobs( members.size() );
+		clau::parallel_for(members.size(), threads, 16, [&](std::size_t begin, std::size_t end) {
+			for(std::size_t i=begin; i<end; ++i) blobs[i] = members[i]->save_binary();
+		});
+		bool saved = false;
+		without_gil([&]() { saved = clau::write_population<D>(path, blobs, scores); });
+		return saved;
+	}
+	
+	static std::shared_ptr<file_type> from_path(const std::string& path) {
+		auto file = std::make_shared<file_type>(path);
+		if( !file->is_open() ) {
+			PyErr_SetString(PyExc_IOError, ("not a saved population: " + path).c_str());
+			boost::python::throw_error_already_set();
+		}
+		return file;
+	}
+	
+	static boost::python::object fitness(const file_type& file) { //a float64 array
+		namespace bp = boost::python;
+		bp::object numpy = bp::import("numpy");
+		bp::object result = numpy.attr("empty")(file.size(), bp::object(numpy.attr("float64")));
+		py_buffer output(result.ptr(), PyBUF_CONTIG);
+		std::copy(file.get_fitness().begin(), file.get_fitness().end(), 
+			  static_cast<double*>(output.view.buf));
+		return result;
+	}
+	
+	static boost::python::list load(const file_type& file, const std::size_t begin, 
+					const std::size_t end, const unsigned int threads) {
+		//new python Ferns, filled in place with the GIL released
+		namespace bp = boost::python;
+		if(begin > end || end > file.size()) {
+			IndexError();
+			bp::throw_error_already_set();
+		}
+		bp::object fern_class = bp::import("fernpy").attr( D==1 ? "fern1" : "fern2" );
+		bp::list ferns;
+		std::vector<clau::Fern<D>*> targets;
+		for(std::size_t i=begin; i<end; ++i) {
+			bp::object fern = fern_class();
+			targets.push_back( &bp::extract<clau::Fern<D>&>(fern)() );
+			ferns.append(fern);
+		}
+		std::atomic<bool> loaded(true);
+		without_gil([&]() {
+			clau::parallel_for(targets.size(), threads, 16, 
+				[&](std::size_t first, std::size_t last) {
+					for(std::size_t i=first; i<last; ++i) 
+						if( !file.load(begin+i, *targets[i]) ) loaded = false;
+				});
+		});
+		if( !loaded ) {
+			PyErr_SetString(PyExc_ValueError, "a saved Fern is damaged");
+			bp::throw_error_already_set();
+		}
+		return ferns;
+	}
+	
+	static boost::python::object get(const file_type& file, int i) { //one Fern, loaded now
+		if( i<0 ) i += file.size();
+		if( i<0 ) i = file.size(); //out of range either way
+		return load(file, i, i+1, 1)[0];
+	}
+};
+
+boost::python::tuple load_population(const std::string& path, const unsigned int threads) {
+	//(ferns, fitness) in the dimension the file was saved in
+	namespace bp = boost::python;
+	clau::PopulationFile<1> file1(path);
+	if( file1.is_open() ) return bp::make_tuple(population_file_py<1>::load(file1, 0, 
+		file1.size(), threads), population_file_py<1>::fitness(file1));
+	auto file2 = population_file_py<2>::from_path(path);
+	return bp::make_tuple(population_file_py<2>::load(*file2, 0, file2->size(), threads), 
+			      population_file_py<2>::fitness(*file2));
+}
+
+bool save_population(const std::string& path, boost::python::list ferns, 
+		     boost::python::object fitness, const unsigned int threads) {
+	//the first member picks the dimension; an empty list is saved as 1D
+	if( boost::python::len(ferns) > 0 && 
+	    boost::python::extract<const clau::Fern<2>&>(ferns[0]).check() ) 
+		return population_file_py<2>::save(path, ferns, fitness, threads);
+	return population_file_py<1>::save(path, ferns, fitness, threads);
+}
+
 /*
 template<class T>
 inline PyObject * managingPyObject(T *p) {
@@ -244,6 +869,21 @@ BOOST_PYTHON_MODULE(fernpy) {
 		.def( self_ns::str(self) )
 		.def_pickle(std_pickle<Interval>());
 	
+	class_<SimulationSettings>("simulation_settings")
+		.def_readwrite("t_final", &SimulationSettings::t_final)
+		.def_readwrite("dt", &SimulationSettings::dt)
+		.def_readwrite("adaptive", &SimulationSettings::adaptive)
+		.def_readwrite("tolerance", &SimulationSettings::tolerance)
+		.def_readwrite("event_tolerance", &SimulationSettings::event_tolerance)
+		.def_readwrite("dead_zone", &SimulationSettings::dead_zone)
+		.def_readwrite("step_budget", &SimulationSettings::step_budget);
+	
+	def("satellite_plant", &satellite_plant, (arg("thrust")=0.5, arg("inertia")=100.0));
+	def("velocity_plant", &velocity_plant, (arg("thrust")=0.5));
+	def("save_population", &::save_population, 
+	    (arg("path"), arg("ferns"), arg("fitness"), arg("threads")=1));
+	def("load_population", &::load_population, (arg("path"), arg("threads")=1));
+	
 	//////////////////////////////////////////////////////////////////////////
 	
 	class_< Region<1> >("region1")
@@ -286,10 +926,33 @@ BOOST_PYTHON_MODULE(fernpy) {
 		.def("get_bounds", &Fern<1>::get_bounds)
 		.def("get_region", &Fern<1>::get_region)
 		.def("get_num_bins", &Fern<1>::get_num_bins)
+		.def("get_num_nodes", &Fern<1>::get_num_nodes)
+		.def("get_num_leaves", &Fern<1>::get_num_leaves)
+		.def("leaves", &fern_array<1>::leaves)
+		.def("set_grid", &Fern<1>::set_grid, 
+		     (arg("resolution"), arg("max_bytes")=Fern<1>::grid_bytes))
+		.def("get_grid_resolution", &Fern<1>::get_grid_resolution)
 		.def("randomize", &Fern<1>::randomize)
 		.def("mutate", &Fern<1>::mutate)
-		.def("crossover", &Fern<1>::crossover)
+		.def("crossover", static_cast<void (Fern<1>::*)(const Fern<1>&)>(
+			&Fern<1>::crossover))
+		.def("crossover", static_cast<void (Fern<1>::*)(const Fern<1>&, 
+			const Fern<1>::pairing&)>(&Fern<1>::crossover))
 		.def("query", &Fern<1>::query)
+		.def("query_array", &fern_array<1>::query_array, 
+		     (arg("points"), arg("threads")=1))
+		.def("rasterize", &fern_array<1>::rasterize, 
+		     (arg("region"), arg("width"), arg("height")=1, arg("threads")=1))
+		.def("accuracy", &fern_array<1>::accuracy, 
+		     (arg("points"), arg("labels"), arg("threads")=1))
+		.def("weighted_accuracy", &fern_array<1>::weighted_accuracy, 
+		     (arg("points"), arg("labels"), arg("weights"), arg("threads")=1))
+		.def("confusion_matrix", &fern_array<1>::confusion_matrix, 
+		     (arg("points"), arg("labels"), arg("threads")=1))
+		.def("simulate", &simulation_py<1>::simulate)
+		.def("tracking_error", &simulation_py<1>::tracking_error, 
+		     (arg("plant"), arg("initial"), arg("settings"), arg("penalty")=1000.0))
+		.def("save_mapped", &mapped_py<1>::save)
 		.def( self_ns::str(self) )
 		.def("begin", &Fern<1>::begin)
 		.def_pickle(fern_pickle<1>());
@@ -303,6 +966,72 @@ BOOST_PYTHON_MODULE(fernpy) {
 		.def_readwrite("dimension", &Division<1>::dimension)
 		.def_pickle(std_pickle< Division<1> >());
 	
+	class_< Plant<1>, std::shared_ptr< Plant<1> > >("plant1", no_init)
+		.def("__init__", make_constructor(&simulation_py<1>::from_callable));
+	
+	class_< MappedFern<1>, std::shared_ptr< MappedFern<1> >, boost::noncopyable >(
+		"mapped_fern1", no_init)
+		.def("__init__", make_constructor(&mapped_py<1>::from_path))
+		.def("query", &MappedFern<1>::query)
+		.def("query_array", &mapped_py<1>::query_array, 
+		     (arg("points"), arg("threads")=1))
+		.def("verify", &MappedFern<1>::verify)
+		.def("get_region", &MappedFern<1>::get_region)
+		.def("get_num_bins", &MappedFern<1>::get_num_bins)
+		.def("__len__", &MappedFern<1>::size);
+	
+	class_< ThresholdFern >("threshold_fern1", init<const Fern<1>&>())
+		.def("compile", static_cast<void (ThresholdFern::*)(const Fern<1>&)>(
+			&ThresholdFern::compile))
+		.def("query", static_cast<bin_type (ThresholdFern::*)(const Point<1>&) const>(
+			&ThresholdFern::query))
+		.def("query_array", &threshold_py::query_array, 
+		     (arg("points"), arg("threads")=1))
+		.def("thresholds", &threshold_py::thresholds)
+		.def("get_region", &ThresholdFern::get_region)
+		.def("get_num_bins", &ThresholdFern::get_num_bins)
+		.def("__len__", &ThresholdFern::size);
+	
+	class_< PopulationFile<1>, std::shared_ptr< PopulationFile<1> >, boost::noncopyable >(
+		"population_file1", no_init)
+		.def("__init__", make_constructor(&population_file_py<1>::from_path))
+		.def("fitness", &population_file_py<1>::fitness)
+		.def("load", &population_file_py<1>::load, 
+		     (arg("begin"), arg("end"), arg("threads")=1))
+		.def("__len__", &PopulationFile<1>::size)
+		.def("__getitem__", &population_file_py<1>::get);
+	
+	class_< Fern<1>::pairing >("pairing1", init<const Fern<1>&, const Fern<1>&>())
+		.def("__len__", &Fern<1>::pairing::size);
+	
+	class_< Population<1>, std::shared_ptr< Population<1> > >("population1", no_init)
+		.def("__init__", make_constructor(&population_py<1>::from_ancestor))
+		.def("__init__", make_constructor(&population_py<1>::from_list))
+		.def("set_fitness", &population_py<1>::set_fitness)
+		.def("seed", &Population<1>::seed)
+		.def("set_threads", &Population<1>::set_threads)
+		.def("get_threads", &Population<1>::get_threads)
+		.def("set_elites", &Population<1>::set_elites)
+		.def("get_elites", &Population<1>::get_elites)
+		.def("set_mutation_rate", &Population<1>::set_mutation_rate)
+		.def("get_mutation_rate", &Population<1>::get_mutation_rate)
+		.def("set_crossover_rate", &Population<1>::set_crossover_rate)
+		.def("get_crossover_rate", &Population<1>::get_crossover_rate)
+		.def("set_roulette", &Population<1>::set_roulette)
+		.def("set_tournament", &Population<1>::set_tournament)
+		.def("get_tournament_size", &Population<1>::get_tournament_size)
+		.def("get_generation", &Population<1>::get_generation)
+		.def("randomize", &Population<1>::randomize)
+		.def("evaluate", &population_py<1>::evaluate)
+		.def("breed", &population_py<1>::breed)
+		.def("run", &population_py<1>::run)
+		.def("best", &population_py<1>::best)
+		.def("fitness", &population_py<1>::fitness)
+		.def("timings", &population_py<1>::timings)
+		.def("__len__", &Population<1>::size)
+		.def("__getitem__", &population_py<1>::get)
+		.def("__setitem__", &population_py<1>::set);
+	
 	class_< Fern<1>::node_handle >("node_handle1") 
 		.def( init<const Fern<1>::node_handle&>() )
 		//.def("__copy__", &std_copy< Fern<DIM>::node_handle >)
@@ -377,10 +1106,33 @@ BOOST_PYTHON_MODULE(fernpy) {
 		.def("get_bounds", &Fern<2>::get_bounds)
 		.def("get_region", &Fern<2>::get_region)
 		.def("get_num_bins", &Fern<2>::get_num_bins)
+		.def("get_num_nodes", &Fern<2>::get_num_nodes)
+		.def("get_num_leaves", &Fern<2>::get_num_leaves)
+		.def("leaves", &fern_array<2>::leaves)
+		.def("set_grid", &Fern<2>::set_grid, 
+		     (arg("resolution"), arg("max_bytes")=Fern<2>::grid_bytes))
+		.def("get_grid_resolution", &Fern<2>::get_grid_resolution)
 		.def("randomize", &Fern<2>::randomize)
 		.def("mutate", &Fern<2>::mutate)
-		.def("crossover", &Fern<2>::crossover)
+		.def("crossover", static_cast<void (Fern<2>::*)(const Fern<2>&)>(
+			&Fern<2>::crossover))
+		.def("crossover", static_cast<void (Fern<2>::*)(const Fern<2>&, 
+			const Fern<2>::pairing&)>(&Fern<2>::crossover))
 		.def("query", &Fern<2>::query)
+		.def("query_array", &fern_array<2>::query_array, 
+		     (arg("points"), arg("threads")=1))
+		.def("rasterize", &fern_array<2>::rasterize, 
+		     (arg("region"), arg("width"), arg("height")=1, arg("threads")=1))
+		.def("accuracy", &fern_array<2>::accuracy, 
+		     (arg("points"), arg("labels"), arg("threads")=1))
+		.def("weighted_accuracy", &fern_array<2>::weighted_accuracy, 
+		     (arg("points"), arg("labels"), arg("weights"), arg("threads")=1))
+		.def("confusion_matrix", &fern_array<2>::confusion_matrix, 
+		     (arg("points"), arg("labels"), arg("threads")=1))
+		.def("simulate", &simulation_py<2>::simulate)
+		.def("tracking_error", &simulation_py<2>::tracking_error, 
+		     (arg("plant"), arg("initial"), arg("settings"), arg("penalty")=1000.0))
+		.def("save_mapped", &mapped_py<2>::save)
 		.def( self_ns::str(self) )
 		.def("begin", &Fern<2>::begin)
 		.def_pickle(fern_pickle<2>());
@@ -394,6 +1146,60 @@ BOOST_PYTHON_MODULE(fernpy) {
 		.def_readwrite("dimension", &Division<2>::dimension)
 		.def_pickle(std_pickle< Division<2> >());
 	
+	class_< Plant<2>, std::shared_ptr< Plant<2> > >("plant2", no_init)
+		.def("__init__", make_constructor(&simulation_py<2>::from_callable));
+	
+	class_< MappedFern<2>, std::shared_ptr< MappedFern<2> >, boost::noncopyable >(
+		"mapped_fern2", no_init)
+		.def("__init__", make_constructor(&mapped_py<2>::from_path))
+		.def("query", &MappedFern<2>::query)
+		.def("query_array", &mapped_py<2>::query_array, 
+		     (arg("points"), arg("threads")=1))
+		.def("verify", &MappedFern<2>::verify)
+		.def("get_region", &MappedFern<2>::get_region)
+		.def("get_num_bins", &MappedFern<2>::get_num_bins)
+		.def("__len__", &MappedFern<2>::size);
+	
+	class_< PopulationFile<2>, std::shared_ptr< PopulationFile<2> >, boost::noncopyable >(
+		"population_file2", no_init)
+		.def("__init__", make_constructor(&population_file_py<2>::from_path))
+		.def("fitness", &population_file_py<2>::fitness)
+		.def("load", &population_file_py<2>::load, 
+		     (arg("begin"), arg("end"), arg("threads")=1))
+		.def("__len__", &PopulationFile<2>::size)
+		.def("__getitem__", &population_file_py<2>::get);
+	
+	class_< Fern<2>::pairing >("pairing2", init<const Fern<2>&, const Fern<2>&>())
+		.def("__len__", &Fern<2>::pairing::size);
+	
+	class_< Population<2>, std::shared_ptr< Population<2> > >("population2", no_init)
+		.def("__init__", make_constructor(&population_py<2>::from_ancestor))
+		.def("__init__", make_constructor(&population_py<2>::from_list))
+		.def("set_fitness", &population_py<2>::set_fitness)
+		.def("seed", &Population<2>::seed)
+		.def("set_threads", &Population<2>::set_threads)
+		.def("get_threads", &Population<2>::get_threads)
+		.def("set_elites", &Population<2>::set_elites)
+		.def("get_elites", &Population<2>::get_elites)
+		.def("set_mutation_rate", &Population<2>::set_mutation_rate)
+		.def("get_mutation_rate", &Population<2>::get_mutation_rate)
+		.def("set_crossover_rate", &Population<2>::set_crossover_rate)
+		.def("get_crossover_rate", &Population<2>::get_crossover_rate)
+		.def("set_roulette", &Population<2>::set_roulette)
+		.def("set_tournament", &Population<2>::set_tournament)
+		.def("get_tournament_size", &Population<2>::get_tournament_size)
+		.def("get_generation", &Population<2>::get_generation)
+		.def("randomize", &Population<2>::randomize)
+		.def("evaluate", &population_py<2>::evaluate)
+		.def("breed", &population_py<2>::breed)
+		.def("run", &population_py<2>::run)
+		.def("best", &population_py<2>::best)
+		.def("fitness", &population_py<2>::fitness)
+		.def("timings", &population_py<2>::timings)
+		.def("__len__", &Population<2>::size)
+		.def("__getitem__", &population_py<2>::get)
+		.def("__setitem__", &population_py<2>::set);
+	
 	class_< Fern<2>::node_handle >("node_handle2") 
 		.def( init<const Fern<2>::node_handle&>() )
 		//.def("__copy__", &std_copy< Fern<DIM>::node_handle >)
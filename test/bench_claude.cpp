@@ -0,0 +1,519 @@
+/*
+    Claude: a real-to-discrete coding scheme based on spiraling trees
+    Copyright (C) 2012  Jack Hall
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+    e-mail: jackwhall7@gmail.com
+*/
+
+//to benchmark Claude, run the following from the test directory:
+//	g++ -std=c++11 -O2 -I../src bench_claude.cpp -o bench_claude -lpthread
+//	./bench_claude
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <vector>
+#include "Fern.h"
+#include "CompiledFern.h"
+#include "MappedFern.h"
+#include "ThresholdFern.h"
+#include "Population.h"
+
+namespace {
+
+	using namespace clau;
+
+	double best_seconds(std::function<void()> run, int repeats=5) {
+		//best of several runs, to keep noise from other processes out
+		double best = 1e30;
+		for(int i=0; i<repeats; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			run();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			if(elapsed.count() < best) best = elapsed.count();
+		}
+		return best;
+	}
+
+	template<dim_type D>
+	void grow(Fern<D>& fern, const unsigned int forks, std::mt19937& generator) {
+		//splits leaves reached by random descents, then scatters bins
+		std::bernoulli_distribution coin(0.5);
+		std::uniform_int_distribution<dim_type> dimension(1, D);
+		auto node = fern.begin();
+		for(unsigned int n=1; n<forks; ++n) {
+			node.root();
+			while( !node.is_leaf() ) {
+				if( coin(generator) ) node.left();
+				else node.right();
+			}
+			node.split_leaf( Division<D>(coin(generator), dimension(generator)) );
+		}
+		std::uniform_int_distribution<bin_type> bin(0, fern.get_num_bins()-1);
+		for(auto it = fern.sbegin(); !it.is_null(); ++it)
+			if( it.is_leaf() ) it.set_leaf_bin( bin(generator) );
+	}
+
+	template<dim_type D>
+	std::vector<num_type> random_points(const Region<D>& region, const std::size_t count,
+					    std::mt19937& generator) {
+		//AoS, spread a little past the region on every side
+		std::vector<num_type> points(D*count);
+		for(int i=0; i<D; ++i) {
+			Interval interval = region(i+1);
+			std::uniform_real_distribution<num_type> coordinate(
+				interval.lower - 0.05*interval.span(), interval.upper + 0.05*interval.span());
+			for(std::size_t n=0; n<count; ++n) points[n*D + i] = coordinate(generator);
+		}
+		return points;
+	}
+
+	//the virtual node layout Fern used before it stored nodes as pool records
+	struct LegacyNode {
+		LegacyNode* parent;
+		bool leaf;
+		virtual ~LegacyNode() {}
+	};
+	struct LegacyLeaf : public LegacyNode { bin_type bin; };
+	template<dim_type D>
+	struct LegacyFork : public LegacyNode {
+		LegacyNode *left, *right;
+		Division<D> value;
+		num_type boundary;
+	};
+
+	template<dim_type D>
+	void bench_footprint(const char* name, const Region<D>& region, const bin_type bins,
+			     const unsigned int forks, std::mt19937& generator) {
+		//bytes per Fern; the legacy figure leaves out allocator overhead
+		Fern<D> fern(region, bins);
+		grow(fern, forks, generator);
+		fern.compact();
+		std::size_t legacy = forks*sizeof(LegacyFork<D>) + (forks+1)*sizeof(LegacyLeaf);
+		std::printf("%-28s %7u %9zu %9zu %8.2fx\n", name, forks, legacy, 
+			    fern.footprint(), double(legacy)/fern.footprint());
+	}
+
+	template<dim_type D>
+	void bench_population(const char* name, const Region<D>& region, const bin_type bins,
+			      const unsigned int forks, const unsigned int members, 
+			      std::mt19937& generator) {
+		//one generation: every member is a copy of the parent, mutated once;
+		//a deep copy is what every copy cost before Ferns shared subtrees
+		Fern<D> parent(region, bins);
+		grow(parent, forks, generator);
+		parent.compact();
+		std::vector< Fern<D> > population;
+		population.reserve(members);
+		
+		double deep = best_seconds([&]() {
+			population.clear();
+			for(unsigned int i=0; i<members; ++i) {
+				population.push_back(parent);
+				population.back().compact();
+				population.back().mutate();
+			}
+		}, 3);
+		std::size_t deep_bytes = 0;
+		for(auto& member : population) deep_bytes += member.footprint();
+		
+		double shared = best_seconds([&]() {
+			population.clear();
+			for(unsigned int i=0; i<members; ++i) {
+				population.push_back(parent);
+				population.back().mutate();
+			}
+		}, 3);
+		std::size_t shared_bytes = parent.footprint(); //one pool for the lot
+		
+		std::printf("%-28s %7u %7u %9.1f %9.1f %9zu %9zu\n", name, forks, members, 
+			    1e6*deep/members, 1e6*shared/members, deep_bytes/1024, shared_bytes/1024);
+	}
+
+	template<dim_type D>
+	void bench_generation(const char* name, const Region<D>& region, const bin_type bins,
+			      const unsigned int forks, const unsigned int members, 
+			      std::mt19937& generator) {
+		//breeding alone: fitness is a constant, so scoring costs next to nothing
+		Fern<D> ancestor(region, bins);
+		grow(ancestor, forks, generator);
+		Population<D> population(ancestor, members, [](const Fern<D>&) { return 1.0; });
+		population.seed(2012);
+		const unsigned int generations = 200;
+		double roulette = best_seconds([&]() { population.run(generations); }, 3);
+		population.set_tournament(3);
+		double tournament = best_seconds([&]() { population.run(generations); }, 3);
+		std::printf("%-28s %7u %7u %9.1f %9.1f\n", name, forks, members, 
+			    1e6*roulette/generations, 1e6*tournament/generations);
+	}
+	
+	template<dim_type D>
+	typename Fern<D>::node_handle legacy_pick(Fern<D>& fern, const bool want_leaf, 
+						   std::mt19937& generator) {
+		//the selection Fern::mutate used to make: a reservoir-sampling pass 
+		//over every node, repeated until the pick has the wanted type
+		typename Fern<D>::node_handle choice;
+		do {
+			auto it = fern.sbegin();
+			choice = it.get_handle();
+			unsigned int n = 1;
+			for(; !it.is_null(); ++it, ++n)
+				if( (1.0/n) >= std::generate_canonical<num_type,16>(generator) ) 
+					choice = it.get_handle();
+		} while( choice.is_leaf() != want_leaf );
+		return choice;
+	}
+
+	template<dim_type D>
+	void bench_selection(const char* name, const Region<D>& region, const bin_type bins,
+			     const unsigned int forks, std::mt19937& generator) {
+		Fern<D> fern(region, bins);
+		grow(fern, forks, generator);
+		auto node = fern.begin();
+		std::bernoulli_distribution coin(0.5);
+		
+		//one pick is a leaf or a fork with equal chance, as in mutate()
+		unsigned int picks = 2000000/forks + 10;
+		double legacy = best_seconds([&]() {
+			for(unsigned int i=0; i<picks; ++i) legacy_pick(fern, coin(generator), generator); 
+		}, 3) / picks;
+		picks = 200000;
+		double retry = best_seconds([&]() {
+			for(unsigned int i=0; i<picks; ++i) {
+				bool want_leaf = coin(generator);
+				do node.random(); while( node.is_leaf() != want_leaf );
+			}
+		}) / picks;
+		double typed = best_seconds([&]() {
+			for(unsigned int i=0; i<picks; ++i) {
+				if( coin(generator) ) node.random_leaf();
+				else node.random_fork();
+			}
+		}) / picks;
+		double mutate = best_seconds([&]() {
+			Fern<D> copy(fern);
+			for(unsigned int i=0; i<picks; ++i) copy.mutate();
+		}) / picks;
+		
+		std::printf("%-28s %7u %9.0f %9.0f %9.0f %9.0f %8.0fx\n", name, forks, 
+			    1e9*legacy, 1e9*retry, 1e9*typed, 1e9*mutate, legacy/typed);
+	}
+
+	template<dim_type D>
+	void bench_binary(const char* name, const Region<D>& region, const bin_type bins,
+			  const unsigned int forks, std::mt19937& generator) {
+		Fern<D> fern(region, bins), loaded;
+		grow(fern, forks, generator);
+		std::string data;
+		double save = best_seconds([&]() { data = fern.save_binary(); });
+		double load = best_seconds([&]() { loaded.load_binary(data.data(), data.size()); });
+		std::size_t nodes = fern.get_num_nodes();
+		std::printf("%-28s %7u %9zu %9.2f %9.2f %9.0f %9.0f\n", name, forks, data.size(),
+			    1e9*save/nodes, 1e9*load/nodes, 1e-6*nodes/save, 1e-6*nodes/load);
+	}
+	
+	void bench_spine(const unsigned int rounds) {
+		//one chain of 2^rounds forks; costs per fork or per level should stay flat
+		Region<1> region;
+		region(1) = Interval(0.0, 1.0);
+		Fern<1> fern(region, 3);
+		auto start = std::chrono::steady_clock::now();
+		for(unsigned int round=0; round<rounds; ++round) {
+			Fern<1> copy(fern);
+			auto deepest = fern.begin();
+			while( !deepest.is_leaf() ) deepest.right();
+			deepest.splice(copy.begin());
+		}
+		std::chrono::duration<double> build = std::chrono::steady_clock::now() - start;
+		const std::size_t forks = std::size_t(1) << rounds;
+		
+		Point<1> high;
+		high(1) = 1.0; //reaches the bottom
+		volatile bin_type sink = 0;
+		double query = best_seconds([&]() { sink = fern.query(high); });
+		double bounds = best_seconds([&]() { fern.set_bounds(region); });
+		double claim = best_seconds([&]() {
+			Fern<1> changed(fern);
+			auto bottom = changed.begin();
+			while( !bottom.is_leaf() ) bottom.right();
+			bottom.set_leaf_bin(1);
+		}); //copies the whole spine, then frees it
+		fern.compact();
+		std::printf("%-28s %7zu %9.1f %9.2f %9.1f %9.1f %9.1f\n", "1D spine", forks,
+			    1e9*build.count()/forks, 1e9*query/forks, 1e9*bounds/forks, 
+			    1e9*claim/forks, double(fern.footprint())/forks);
+	}
+	
+	template<dim_type D>
+	void bench_mapped(const char* name, const Region<D>& region, const bin_type bins,
+			  const unsigned int forks, std::mt19937& generator) {
+		//startup: parsing the binary format against mapping a model file
+		Fern<D> fern(region, bins), loaded;
+		grow(fern, forks, generator);
+		std::string data = fern.save_binary();
+		const char* path = "bench_mapped.bin";
+		MappedFern<D>::write(fern, path);
+		Point<D> point;
+		for(int i=1; i<=D; ++i) point(i) = 0.5*(region(i).lower + region(i).upper);
+		volatile bin_type sink = 0; //keeps the first query
+		double load = best_seconds([&]() {
+			loaded.load_binary(data.data(), data.size());
+			sink = loaded.query(point);
+		});
+		double map = best_seconds([&]() {
+			MappedFern<D> mapped(path);
+			sink = mapped.query(point);
+		});
+		std::remove(path);
+		std::printf("%-28s %7u %9.1f %9.1f %8.1fx\n", name, forks, 1e6*load, 1e6*map,
+			    load/map);
+	}
+	
+	template<dim_type D>
+	void bench_raster(const char* name, const Region<D>& region, const bin_type bins,
+			  const unsigned int forks, std::mt19937& generator) {
+		//a 4096 x 4096 map: query_batch at every pixel center against rasterize
+		Fern<D> fern(region, bins);
+		grow(fern, forks, generator);
+		const std::size_t side = 4096, count = side*side;
+		std::vector<num_type> centers(2*count);
+		for(std::size_t y=0; y<side; ++y)
+			for(std::size_t x=0; x<side; ++x) {
+				centers[2*(y*side + x)] = region(1).lower + (x + 0.5)*region(1).span()/side;
+				centers[2*(y*side + x) + 1] = region(D).lower + (y + 0.5)*region(D).span()/side;
+			}
+		std::array<const num_type*, D> bases;
+		for(int i=0; i<D; ++i) bases[i] = centers.data() + i;
+		std::vector<bin_type> grid(count);
+		double batch = best_seconds([&]() {
+			fern.query_batch(bases, 2, count, grid.data(), 1); }, 3);
+		double raster = best_seconds([&]() {
+			fern.rasterize(region, side, side, grid.data(), 1); });
+		double all = best_seconds([&]() {
+			fern.rasterize(region, side, side, grid.data(), 0); });
+		std::printf("%-28s %7u %9.1f %9.1f %9.1f %8.1fx\n", name, forks, 1e3*batch,
+			    1e3*raster, 1e3*all, batch/raster);
+	}
+	
+	template<dim_type D>
+	void bench_query(const char* name, const Region<D>& region, const bin_type bins,
+			 const unsigned int forks, std::mt19937& generator) {
+		Fern<D> fern(region, bins);
+		grow(fern, forks, generator);
+		CompiledFern<D> compiled(fern);
+
+		const std::size_t count = 1 << 20;
+		std::vector<num_type> points = random_points(region, count, generator);
+		std::vector<bin_type> out(count);
+		std::array<const num_type*, D> bases;
+		for(int i=0; i<D; ++i) bases[i] = points.data() + i;
+
+		double pointer = best_seconds([&]() {
+			Point<D> point;
+			for(std::size_t n=0; n<count; ++n) {
+				for(int i=0; i<D; ++i) point(i+1) = points[n*D + i];
+				out[n] = fern.query(point);
+			}
+		});
+		double scalar = best_seconds([&]() {
+			compiled.query_batch(bases, D, count, out.data(), 1, scalar_kernel); });
+		double sse4 = best_seconds([&]() {
+			compiled.query_batch(bases, D, count, out.data(), 1, sse4_kernel); });
+		double avx2 = best_seconds([&]() {
+			compiled.query_batch(bases, D, count, out.data(), 1, avx2_kernel); });
+
+		std::printf("%-28s %7u %9.2f %9.2f %9.2f %9.2f %8.2fx\n", name, forks,
+			    1e9*pointer/count, 1e9*scalar/count, 1e9*sse4/count,
+			    1e9*avx2/count, scalar/avx2);
+	}
+
+	template<dim_type D>
+	void bench_grid(const char* name, const Region<D>& region, const bin_type bins,
+			const unsigned int forks, std::mt19937& generator) {
+		//Fern::query_batch from the root, then through grids of a few sizes
+		Fern<D> fern(region, bins);
+		grow(fern, forks, generator);
+		const std::size_t count = 1 << 20;
+		std::vector<num_type> points = random_points(region, count, generator);
+		std::vector<bin_type> out(count);
+
+		double plain = best_seconds([&]() {
+			fern.query_batch(points.data(), count, out.data(), 1); });
+		std::printf("%-28s %7u %9.2f", name, forks, 1e9*plain/count);
+		for(unsigned int resolution : {16u, 64u, 512u}) {
+			fern.set_grid(resolution, std::size_t(1) << 30);
+			double build = best_seconds([&]() {
+				fern.set_grid(resolution, std::size_t(1) << 30);
+				fern.query(Point<D>()); //the first query builds it
+			});
+			double query = best_seconds([&]() {
+				fern.query_batch(points.data(), count, out.data(), 1); });
+			std::printf(" %9.2f %7.0f", 1e9*query/count, 1e6*build);
+		}
+		std::printf("\n");
+	}
+
+	void bench_thresholds(const char* name, const Region<1>& region, const bin_type bins,
+			      const unsigned int forks, std::mt19937& generator) {
+		//the best CompiledFern kernel against a ThresholdFern with each kernel
+		Fern<1> fern(region, bins);
+		grow(fern, forks, generator);
+		CompiledFern<1> compiled(fern);
+		ThresholdFern flat(fern);
+
+		const std::size_t count = 1 << 20;
+		std::vector<num_type> xs = random_points(region, count, generator);
+		std::vector<bin_type> out(count);
+		std::array<const num_type*, 1> bases = {{xs.data()}};
+
+		double tree = best_seconds([&]() {
+			compiled.query_batch(bases, 1, count, out.data(), 1); });
+		double scalar = best_seconds([&]() {
+			flat.query_batch(bases, 1, count, out.data(), 1, scalar_kernel); });
+		double sse4 = best_seconds([&]() {
+			flat.query_batch(bases, 1, count, out.data(), 1, sse4_kernel); });
+		double avx2 = best_seconds([&]() {
+			flat.query_batch(bases, 1, count, out.data(), 1, avx2_kernel); });
+		double best = std::min(scalar, std::min(sse4, avx2));
+
+		std::printf("%-28s %7u %7zu %9.2f %9.2f %9.2f %9.2f %8.2fx\n", name, forks, 
+			    flat.size(), 1e9*tree/count, 1e9*scalar/count, 1e9*sse4/count, 
+			    1e9*avx2/count, tree/best);
+	}
+
+} //namespace
+
+int main() {
+	using namespace clau;
+	std::mt19937 generator(2012);
+
+	const char* names[] = {"scalar", "sse4", "avx2"};
+	std::printf("best batch kernel on this machine: %s\n\n", names[best_kernel()]);
+
+	//regions follow the 1D and 2D ferns shipped in demo/
+	//(classify_fern.dat, satellite_fern.dat)
+	Region<1> classify;
+	classify(1) = Interval(-3.0, 3.0);
+	Region<2> satellite;
+	satellite(1) = Interval(-12.5664, 12.5664);
+	satellite(2) = Interval(-50.0, 50.0);
+
+	//node size in bytes, then whole-tree footprint after compact()
+	std::printf("%-28s %9s %9s\n", "node size (bytes)", "legacy", "Fern");
+	std::printf("%-28s %9zu %9zu\n", "1D fork", sizeof(LegacyFork<1>), Fern<1>::fork_size());
+	std::printf("%-28s %9zu %9zu\n", "2D fork", sizeof(LegacyFork<2>), Fern<2>::fork_size());
+	std::printf("%-28s %9zu %9d\n\n", "leaf (held in its link)", sizeof(LegacyLeaf), 0);
+	std::printf("%-28s %7s %9s %9s %9s\n", "footprint (bytes)", "forks", 
+		    "legacy", "Fern", "saving");
+	bench_footprint<2>("2D satellite_fern", satellite, 3, 60, generator);
+	bench_footprint<2>("2D", satellite, 3, 10000, generator);
+	std::printf("\n");
+
+	//copy-and-mutate, us per member, and KiB held by the whole population
+	std::printf("%-28s %7s %7s %9s %9s %9s %9s\n", "population", "forks", "members", 
+		    "deep us", "shared us", "deep KiB", "shared KiB");
+	bench_population<2>("2D satellite_fern", satellite, 3, 60, 500, generator);
+	bench_population<2>("2D", satellite, 3, 10000, 50, generator);
+	bench_population<2>("2D", satellite, 3, 10000, 500, generator);
+	std::printf("\n");
+
+	//one generation of Population, us: elitism, selection, crossover, mutation
+	std::printf("%-28s %7s %7s %9s %9s\n", "generation (us)", "forks", "members", 
+		    "roulette", "tournament");
+	bench_generation<1>("1D classify_fern", classify, 2, 13, 50, generator);
+	bench_generation<2>("2D satellite_fern", satellite, 3, 60, 50, generator);
+	bench_generation<2>("2D", satellite, 3, 1000, 500, generator);
+	std::printf("\n");
+	
+	//locus selection, ns per pick: the old reservoir pass, random() retried 
+	//until the type matches, and random_leaf/random_fork; then a whole mutate()
+	std::printf("%-28s %7s %9s %9s %9s %9s %9s\n", "selection (ns)", "forks", 
+		    "reservoir", "retry", "typed", "mutate()", "gain");
+	bench_selection<2>("2D satellite_fern", satellite, 3, 60, generator);
+	bench_selection<2>("2D", satellite, 3, 1000, generator);
+	bench_selection<2>("2D", satellite, 3, 10000, generator);
+	bench_selection<2>("2D", satellite, 3, 100000, generator);
+	std::printf("\n");
+
+	//binary format: bytes, ns per node and millions of nodes a second
+	std::printf("%-28s %7s %9s %9s %9s %9s %9s\n", "binary format", "forks", "bytes", 
+		    "save ns", "load ns", "save M/s", "load M/s");
+	bench_binary<2>("2D satellite_fern", satellite, 3, 60, generator);
+	bench_binary<2>("2D", satellite, 3, 10000, generator);
+	bench_binary<2>("2D", satellite, 3, 100000, generator);
+	std::printf("\n");
+	
+	//a single chain of forks, ns per fork (per level for query), and bytes per fork
+	std::printf("%-28s %7s %9s %9s %9s %9s %9s\n", "deep trees", "forks", "build", 
+		    "query", "bounds", "claim", "bytes");
+	for(unsigned int rounds : {10u, 15u, 20u}) bench_spine(rounds);
+	std::printf("\n");
+	
+	//time to a first answer after startup, us, page cache warm
+	std::printf("%-28s %7s %9s %9s %9s\n", "startup (us)", "forks", "binary", 
+		    "mapped", "gain");
+	bench_mapped<2>("2D satellite_fern", satellite, 3, 60, generator);
+	bench_mapped<2>("2D", satellite, 3, 10000, generator);
+	bench_mapped<2>("2D", satellite, 3, 100000, generator);
+	std::printf("\n");
+	
+	//a 4096 x 4096 map, ms: a batch query per pixel, then rasterize on one 
+	//thread and on every core
+	std::printf("%-28s %7s %9s %9s %9s %9s\n", "raster (ms)", "forks", "batch", 
+		    "raster", "threads", "gain");
+	bench_raster<1>("1D classify_fern", classify, 2, 13, generator);
+	bench_raster<2>("2D satellite_fern", satellite, 3, 60, generator);
+	bench_raster<2>("2D", satellite, 3, 10000, generator);
+	bench_raster<2>("2D", satellite, 3, 100000, generator);
+	std::printf("\n");
+	
+	//query cost, ns/point over 2^20 uniformly scattered points, one thread
+	//fork counts start at those of the demo ferns, then grow past them
+	std::printf("%-28s %7s %9s %9s %9s %9s %9s\n", "query (ns/point)", "forks",
+		    "Fern", "scalar", "sse4", "avx2", "avx2 gain");
+	bench_query<1>("1D classify_fern", classify, 2, 13, generator);
+	bench_query<1>("1D", classify, 2, 1000, generator);
+	bench_query<1>("1D", classify, 2, 10000, generator);
+
+	bench_query<2>("2D satellite_fern", satellite, 3, 60, generator);
+	bench_query<2>("2D", satellite, 3, 1000, generator);
+	bench_query<2>("2D", satellite, 3, 10000, generator);
+	std::printf("\n");
+	
+	//Fern::query_batch with acceleration grids of 16, 64 and 512 cells per 
+	//dimension, ns/point as above, and us to build each grid
+	std::printf("%-28s %7s %9s %9s %7s %9s %7s %9s %7s\n", "grid (ns/point)", "forks", 
+		    "root", "16", "build", "64", "build", "512", "build");
+	bench_grid<1>("1D", classify, 2, 10000, generator);
+	bench_grid<2>("2D satellite_fern", satellite, 3, 60, generator);
+	bench_grid<2>("2D", satellite, 3, 1000, generator);
+	bench_grid<2>("2D", satellite, 3, 10000, generator);
+	bench_grid<2>("2D", satellite, 3, 100000, generator);
+	std::printf("\n");
+	
+	//1D Ferns flattened to sorted thresholds, ns/point as above; the tree 
+	//column is CompiledFern's best kernel
+	std::printf("%-28s %7s %7s %9s %9s %9s %9s %9s\n", "thresholds (ns/point)", "forks",
+		    "kept", "tree", "scalar", "sse4", "avx2", "gain");
+	bench_thresholds("1D classify_fern", classify, 2, 13, generator);
+	bench_thresholds("1D", classify, 2, 1000, generator);
+	bench_thresholds("1D", classify, 2, 10000, generator);
+	bench_thresholds("1D", classify, 2, 100000, generator);
+
+	return 0;
+}
@@ -19,11 +19,28 @@
 */
 
 //to test Claude, run the following from the test directory:
-//	g++ -std=c++11 -g -I../src -lgtest -lpthread test_claude.cpp -o test_claude
+//	g++ -std=c++11 -g -I../src test_claude.cpp -o test_claude -lgtest -lpthread
 //	./test_claude
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include "Fern.h"
+#include "CompiledFern.h"
+#include "Population.h"
+#include "PopulationFile.h"
+#include "Accuracy.h"
+#include "MappedFern.h"
+#include "ThresholdFern.h"
+#include "Simulation.h"
 #include "gtest/gtest.h"
 
 namespace {
@@ -71,6 +88,77 @@ namespace {
 		EXPECT_EQ(one, two);
 	}
 
+	TEST(HelperClasses, Pool) {
+		using namespace clau;
+		Pool<Point<2>> pool;
+		std::vector<Pool<Point<2>>::index_type> points;
+		for(int i=0; i<1000; ++i) points.push_back( pool.create() );
+		EXPECT_EQ(1000, pool.size());
+		for(int i=0; i<1000; ++i) EXPECT_EQ(i, points[i]); //handed out in order
+		pool[7](1) = 3.5;
+		EXPECT_EQ(3.5, pool[7](1));
+		EXPECT_LE(1000*sizeof(Point<2>), pool.footprint());
+		
+		//released slots are handed out again before the array grows
+		pool.destroy(points[500]);
+		EXPECT_EQ(999, pool.size());
+		EXPECT_EQ(500, pool.create());
+		for(auto point : points) pool.destroy(point);
+		EXPECT_EQ(0, pool.size());
+		for(int i=0; i<1000; ++i) EXPECT_GT(1000, pool.create());
+		
+		//copies are independent
+		pool[7](1) = 3.5;
+		Pool<Point<2>> copy(pool);
+		copy[7](1) = -1.0;
+		EXPECT_EQ(3.5, pool[7](1));
+		pool.clear();
+		EXPECT_EQ(0, pool.size());
+		EXPECT_EQ(1000, copy.size());
+	}
+	
+	TEST(HelperClasses, ParallelFor) {
+		using namespace clau;
+		std::vector< std::atomic<int> > calls(5000);
+		for(auto& count : calls) count = 0;
+		std::atomic<int> chunks(0);
+		parallel_for(calls.size(), 4, 1000, [&](std::size_t begin, std::size_t end) {
+			EXPECT_GE(end - begin, 1000u);
+			++chunks;
+			for(std::size_t i=begin; i<end; ++i) ++calls[i];
+		});
+		for(auto& count : calls) EXPECT_EQ(1, count);
+		EXPECT_EQ(4, chunks);
+		
+		//fewer than two grains stays on the calling thread
+		chunks = 0;
+		parallel_for(5000, 4, 4096, [&](std::size_t, std::size_t) { ++chunks; });
+		EXPECT_EQ(1, chunks);
+		
+		//a throw on a worker or on the calling thread comes back here
+		for(std::size_t bad : {0u, 4000u}) 
+			EXPECT_THROW( parallel_for(5000, 4, 100, [bad](std::size_t begin, std::size_t end) { 
+				if(begin <= bad && bad < end) throw std::runtime_error("chunk failed"); 
+			}), std::runtime_error );
+	}
+	
+	TEST(HelperClasses, WorkStealing) {
+		using namespace clau;
+		//the first tasks are slow, so their thread's share has to be stolen
+		std::vector< std::atomic<int> > calls(500);
+		for(auto& count : calls) count = 0;
+		work_stealing_for(calls.size(), 4, [&calls](std::size_t i) {
+			if(i < 10) std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+			++calls[i];
+		});
+		for(auto& count : calls) EXPECT_EQ(1, count);
+		
+		work_stealing_for(0, 4, [](std::size_t) { FAIL(); });
+		EXPECT_THROW( work_stealing_for(100, 4, [](std::size_t i) { 
+			if(i == 50) throw std::runtime_error("task failed"); 
+		}), std::runtime_error );
+	}
+
 	TEST(ConstructionTests, DefaultConstruction) {
 		using namespace clau;
 		Fern<1> fern;
@@ -296,6 +384,211 @@ namespace {
 		EXPECT_FALSE(node2.get_fork_bit());
 	}
 	
+	TEST_F(NodeManipulationTest, LocalBoundaries) {
+		//edits only refresh the subtree they touch; compare against a full refresh
+		using namespace clau;
+		std::mt19937 generator(7);
+		std::bernoulli_distribution coin(0.5);
+		std::uniform_int_distribution<dim_type> dimension(1, 2);
+		for(int n=0; n<300; ++n) {
+			node.root();
+			while( !node.is_leaf() ) {
+				if( coin(generator) ) node.left();
+				else node.right();
+			}
+			if(n % 3 == 0) node.up().set_fork_bit( coin(generator) );
+			else if(n % 3 == 1) node.up().set_fork_dimension( dimension(generator) );
+			else node.split_leaf( Division<2>(coin(generator), dimension(generator)) );
+		}
+		node.root().left();
+		Fern<2> donor(fern);
+		auto graft = donor.begin();
+		graft.right().left();
+		EXPECT_TRUE(node.splice(graft));
+		
+		Fern<2> refreshed(fern);
+		refreshed.set_bounds(region);
+		auto it = fern.sbegin(), jt = refreshed.sbegin();
+		for(; !it.is_null(); ++it, ++jt) {
+			ASSERT_FALSE( jt.is_null() );
+			EXPECT_EQ(jt.get_fork_boundary(), it.get_fork_boundary());
+		}
+	}
+	
+	TEST_F(NodeManipulationTest, Counting) {
+		using namespace clau;
+		EXPECT_EQ(3, fern.get_num_nodes());
+		ExpandFern();
+		EXPECT_EQ(9, fern.get_num_nodes());
+		
+		//random() is uniform over all nodes
+		std::vector<int> hits(9, 0); //by preorder position
+		for(int i=0; i<9000; ++i) {
+			node.random();
+			int position = 0;
+			for(auto it = fern.sbegin(); it.get_handle() != node; ++it) ++position;
+			ASSERT_GT(9, position);
+			++hits[position];
+		}
+		for(int hit : hits) {
+			EXPECT_LT(800, hit);
+			EXPECT_GT(1200, hit);
+		}
+		
+		//counts follow structural edits
+		node.root().left().right();
+		EXPECT_TRUE( node.merge_fork(0) );
+		EXPECT_EQ(7, fern.get_num_nodes());
+		Fern<2> donor(fern);
+		auto graft = donor.begin();
+		node.root().right();
+		EXPECT_TRUE( node.splice(graft.right()) ); //replaces a fork with a fork
+		EXPECT_EQ(7, fern.get_num_nodes());
+		node.root().right();
+		EXPECT_TRUE( node.splice(graft.root()) );
+		EXPECT_EQ(11, fern.get_num_nodes());
+		
+		int counted = 0;
+		for(auto it = fern.sbegin(); !it.is_null(); ++it) ++counted;
+		EXPECT_EQ(11, counted);
+	}
+	
+	TEST_F(NodeManipulationTest, TypedSampling) {
+		using namespace clau;
+		ExpandFern();
+		std::vector<int> hits(9, 0); //by preorder position
+		for(int i=0; i<8000; ++i) {
+			node.random_leaf();
+			ASSERT_TRUE(node.is_leaf());
+			int position = 0;
+			for(auto it = fern.sbegin(); it.get_handle() != node; ++it) ++position;
+			++hits[position];
+			
+			node.random_fork();
+			ASSERT_FALSE(node.is_leaf());
+			position = 0;
+			for(auto it = fern.sbegin(); it.get_handle() != node; ++it) ++position;
+			++hits[position];
+		}
+		int leaves = 0;
+		auto it = fern.sbegin();
+		for(int hit : hits) { //1600 per leaf, 2000 per fork
+			if( it.is_leaf() ) {
+				++leaves;
+				EXPECT_LT(1400, hit);
+				EXPECT_GT(1800, hit);
+			} else {
+				EXPECT_LT(1800, hit);
+				EXPECT_GT(2200, hit);
+			}
+			++it;
+		}
+		EXPECT_EQ(5, leaves);
+		
+		//a bare root is the only fork there is
+		Fern<2> small(region, num_bins);
+		auto root = small.begin();
+		EXPECT_TRUE( root.random_fork().is_root() );
+	}
+	
+	TEST_F(NodeManipulationTest, Pairing) {
+		using namespace clau;
+		ExpandFern();
+		EXPECT_EQ(4, Fern<2>::pairing(fern, fern).size());
+		EXPECT_EQ(0, Fern<2>::pairing(fern, Fern<2>(region, 2)).size()); //bins differ
+		
+		//other shares only the root and root.right with fern
+		Fern<2> other(region, num_bins);
+		auto graft = other.begin();
+		EXPECT_TRUE( graft.right().split_leaf(Division<2>(false, 1)) );
+		Fern<2>::pairing shared(fern, other);
+		ASSERT_EQ(2, shared.size());
+		
+		int roots = 0;
+		for(int i=0; i<1000; ++i) {
+			ASSERT_TRUE( shared.random(node, graft) );
+			ASSERT_FALSE( node.is_leaf() || graft.is_leaf() );
+			ASSERT_EQ(node.is_root(), graft.is_root());
+			if( node.is_root() ) ++roots;
+			else {
+				auto parent = node;
+				EXPECT_TRUE( node == parent.up().right() );
+			}
+		}
+		EXPECT_LT(400, roots);
+		EXPECT_GT(600, roots);
+		
+		//one pairing serves any number of unmodified copies
+		for(int i=0; i<10; ++i) {
+			Fern<2> child(fern);
+			child.crossover(other, shared);
+			int counted = 0;
+			for(auto it = child.sbegin(); !it.is_null(); ++it) ++counted;
+			EXPECT_EQ(child.get_num_nodes(), counted);
+		}
+		
+		//pairs that have since gone from either Fern are refused
+		EXPECT_TRUE( node.root().right().merge_fork(0) );
+		int refused = 0;
+		for(int i=0; i<100; ++i) {
+			if( shared.random(node, graft) ) EXPECT_TRUE( node.is_root() );
+			else ++refused;
+		}
+		EXPECT_LT(20, refused);
+		EXPECT_GT(80, refused);
+	}
+	
+	TEST_F(NodeManipulationTest, Sharing) {
+		using namespace clau;
+		ExpandFern();
+		std::stringstream original;
+		original << fern;
+		
+		//copies share the tree, and changes to one reach no other
+		std::vector< Fern<2> > children(50, fern);
+		for(auto& child : children) 
+			for(int i=0; i<5; ++i) child.mutate();
+		std::stringstream after;
+		after << fern;
+		EXPECT_EQ(original.str(), after.str());
+		
+		std::mt19937 generator(3);
+		std::uniform_real_distribution<num_type> x(0.0, 1.0), y(2.0, 4.0);
+		for(auto& child : children) {
+			//a private copy with every boundary recomputed answers the same
+			Fern<2> alone(child);
+			alone.compact();
+			alone.set_bounds(region);
+			Point<2> point;
+			for(int i=0; i<100; ++i) {
+				point(1) = x(generator);
+				point(2) = y(generator);
+				ASSERT_EQ(alone.query(point), child.query(point));
+			}
+			int counted = 0;
+			for(auto it = child.sbegin(); !it.is_null(); ++it) ++counted;
+			EXPECT_EQ(child.get_num_nodes(), counted);
+		}
+		
+		//a handle into a changed part of the tree becomes a ghost
+		auto leaf = fern.begin();
+		leaf.left().left();
+		EXPECT_TRUE( node.root().left().merge_fork(0) );
+		EXPECT_FALSE( node.is_ghost() );
+		EXPECT_TRUE( leaf.is_ghost() );
+		EXPECT_FALSE( leaf.set_leaf_bin(0) );
+		
+		//a large tree costs little more than itself for 50 lightly mutated copies
+		Fern<2> big(region, num_bins);
+		for(int i=0; i<1000; ++i) big.begin().random_leaf().split_leaf( Division<2>(true, 1) );
+		big.compact();
+		std::size_t bytes = big.footprint();
+		std::vector< Fern<2> > copies(50, big);
+		EXPECT_EQ(bytes, copies.back().footprint());
+		for(auto& copy : copies) copy.mutate();
+		EXPECT_GT(10*bytes, big.footprint()); //not 50 deep copies, even after the pool doubles
+	}
+	
 	class FernTest : public ::testing::Test { //very similar to NodeManipulationTest fixture
 	protected:
 		clau::Interval span1, span2;
@@ -421,6 +714,851 @@ namespace {
 		fern = fern2;
 		EXPECT_TRUE(CheckEqual(fern, fern2));
 	}
+	
+	TEST_F(FernTest, Moving) {
+		using namespace clau;
+		ExpandFern();
+		EXPECT_TRUE( std::is_nothrow_move_constructible< Fern<2> >::value );
+		EXPECT_TRUE( std::is_nothrow_move_assignable< Fern<2> >::value );
+		Fern<2> copy(fern);
+		std::size_t bytes = fern.footprint();
+		
+		//moving takes the tree; handles into the emptied Fern are ghosts
+		Fern<2> moved( std::move(fern) );
+		EXPECT_TRUE(CheckEqual(moved, copy));
+		EXPECT_EQ(bytes, moved.footprint());
+		EXPECT_TRUE( node.is_ghost() );
+		EXPECT_FALSE( node.split_leaf(Division<2>(true, 1)) );
+		EXPECT_FALSE( node.is_leaf() );
+		EXPECT_EQ(0, node.get_fork_dimension());
+		EXPECT_TRUE( node.left().is_ghost() );
+		EXPECT_TRUE( node.right().random().random_fork().random_leaf().is_ghost() );
+		
+		//a moved-from Fern can be assigned to again
+		fern = std::move(moved);
+		EXPECT_TRUE(CheckEqual(fern, copy));
+		moved = copy; //copied into, now that it is empty in turn
+		EXPECT_TRUE(CheckEqual(moved, copy));
+		node = fern.begin();
+		EXPECT_TRUE( node.left().set_fork_bit(false) );
+		EXPECT_FALSE(CheckEqual(fern, copy));
+		
+		//reordering a population moves trees around without copying them
+		std::vector< Fern<2> > population;
+		for(int i=0; i<20; ++i) {
+			population.push_back(copy);
+			for(int j=0; j<i; ++j) population.back().begin().random_leaf().split_leaf(
+				Division<2>(true, 1) );
+		}
+		std::size_t shared_bytes = copy.footprint();
+		std::sort(population.begin(), population.end(), 
+			[](const Fern<2>& one, const Fern<2>& two) 
+				{ return one.get_num_nodes() > two.get_num_nodes(); });
+		for(int i=0; i<20; ++i) EXPECT_EQ(2*(19-i) + 9, population[i].get_num_nodes());
+		EXPECT_EQ(shared_bytes, copy.footprint());
+		swap(population.front(), population.back());
+		EXPECT_EQ(9, population.front().get_num_nodes());
+	}
+	
+	TEST_F(FernTest, Compacting) {
+		using namespace clau;
+		ExpandFern();
+		fern.set_node_type_chance(0.85);
+		for(int i=0; i<500; ++i) fern.mutate();
+		Fern<2> before(fern);
+		
+		fern.compact();
+		EXPECT_TRUE(CheckEqual(fern, before));
+		
+		//the compacted tree must still be fully editable
+		for(int i=0; i<500; ++i) fern.mutate();
+		before = fern;
+		EXPECT_TRUE(CheckEqual(fern, before));
+	}
+	
+	TEST_F(FernTest, Compiling) {
+		using namespace clau;
+		ExpandFern();
+		CompiledFern<2> compiled(fern);
+		EXPECT_EQ(fern.get_region(), compiled.get_region());
+		EXPECT_EQ(fern.get_num_bins(), compiled.get_num_bins());
+		EXPECT_EQ(4, compiled.size());
+		
+		//same spot checks as CheckQuery
+		Point<2> point;
+		point(1) = 0.38;
+		point(2) = 3.234;
+		EXPECT_EQ(0, compiled.query(point));
+		point(2)= 3.238;
+		EXPECT_EQ(1, compiled.query(point));
+		point(1) = .762;
+		point(2) = 3.0;
+		EXPECT_EQ(2, compiled.query(point));
+		point(1) = .766;
+		EXPECT_EQ(0, compiled.query(point));
+		
+		//recompile after random edits, compare on a grid covering the region
+		fern.set_node_type_chance(0.85);
+		for(int i=0; i<20; ++i) {
+			for(int j=0; j<10; ++j) fern.mutate();
+			compiled.compile(fern);
+			for(int x=-5; x<=105; ++x) {
+				for(int y=-5; y<=105; ++y) {
+					point(1) = 0.0 + x*0.01;
+					point(2) = 2.0 + y*0.02;
+					ASSERT_EQ(fern.query(point), compiled.query(point));
+				}
+			}
+		}
+	}
+	
+	TEST_F(FernTest, BatchQuerying) {
+		using namespace clau;
+		ExpandFern();
+		fern.set_node_type_chance(0.85);
+		for(int i=0; i<100; ++i) fern.mutate();
+		CompiledFern<2> compiled(fern);
+		
+		//enough points for several threads' worth of work
+		//not a multiple of the SIMD width, to exercise the scalar tails
+		const std::size_t count = 50003;
+		std::vector<num_type> aos(2*count), xs(count), ys(count);
+		std::mt19937 generator(7);
+		std::uniform_real_distribution<num_type> x_dist(-0.1, 1.1), y_dist(1.9, 4.1);
+		for(std::size_t n=0; n<count; ++n) {
+			aos[2*n] = xs[n] = x_dist(generator);
+			aos[2*n+1] = ys[n] = y_dist(generator);
+		}
+		aos[0] = xs[0] = std::nan(""); //NaNs must take the same branch everywhere
+		aos[3] = ys[1] = std::nan("");
+		std::array<const num_type*, 2> columns = {{xs.data(), ys.data()}};
+		
+		std::vector<bin_type> expected(count);
+		Point<2> point;
+		for(std::size_t n=0; n<count; ++n) {
+			point(1) = xs[n];
+			point(2) = ys[n];
+			expected[n] = fern.query(point);
+		}
+		
+		std::vector<bin_type> bins(count);
+		for(unsigned int threads : {1u, 4u, 0u}) {
+			fern.query_batch(aos.data(), count, bins.data(), threads);
+			EXPECT_EQ(expected, bins);
+			fern.query_batch(columns, count, bins.data(), threads);
+			EXPECT_EQ(expected, bins);
+			compiled.query_batch(aos.data(), count, bins.data(), threads);
+			EXPECT_EQ(expected, bins);
+			compiled.query_batch(columns, count, bins.data(), threads);
+			EXPECT_EQ(expected, bins);
+		}
+		
+		//every kernel, whether or not this machine has it (falls back if not)
+		std::array<const num_type*, 2> interleaved = {{aos.data(), aos.data()+1}};
+		for(kernel_type kernel : {scalar_kernel, sse4_kernel, avx2_kernel}) {
+			std::fill(bins.begin(), bins.end(), 0);
+			compiled.query_batch(interleaved, 2, count, bins.data(), 1, kernel);
+			EXPECT_EQ(expected, bins);
+			std::fill(bins.begin(), bins.end(), 0);
+			compiled.query_batch(columns, 1, count, bins.data(), 3, kernel);
+			EXPECT_EQ(expected, bins);
+		}
+		
+		//1D ferns take a shortcut in the AVX2 kernel
+		Region<1> line;
+		line(1) = span1;
+		Fern<1> fern1(line, num_bins);
+		fern1.set_node_type_chance(0.85);
+		fern1.randomize(200);
+		CompiledFern<1> compiled1(fern1);
+		Point<1> point1;
+		for(std::size_t n=0; n<count; ++n) {
+			point1(1) = xs[n];
+			expected[n] = fern1.query(point1);
+		}
+		for(kernel_type kernel : {scalar_kernel, sse4_kernel, avx2_kernel}) {
+			std::fill(bins.begin(), bins.end(), 0);
+			compiled1.query_batch({{xs.data()}}, 1, count, bins.data(), 1, kernel);
+			EXPECT_EQ(expected, bins);
+		}
+	}
+	
+	TEST_F(FernTest, Thresholds) {
+		using namespace clau;
+		Region<1> line;
+		line(1) = span1;
+		Fern<1> fern1(line, num_bins);
+		fern1.set_node_type_chance(0.85);
+		fern1.randomize(300);
+		ThresholdFern flat(fern1);
+		
+		//sorted, with no two neighbouring intervals in one bin
+		std::vector<num_type> thresholds = flat.get_thresholds();
+		std::vector<bin_type> bins = flat.get_bins();
+		ASSERT_EQ(flat.size(), thresholds.size());
+		ASSERT_EQ(thresholds.size()+1, bins.size());
+		EXPECT_TRUE( std::is_sorted(thresholds.begin(), thresholds.end()) );
+		for(std::size_t i=1; i<bins.size(); ++i) EXPECT_NE(bins[i-1], bins[i]);
+		EXPECT_GE(fern1.get_num_leaves(), bins.size());
+		
+		//points past the region, NaN, infinities and the thresholds themselves
+		const std::size_t count = 20011;
+		std::vector<num_type> xs(2*count);
+		std::mt19937 generator(11);
+		std::uniform_real_distribution<num_type> x_dist(-0.1, 1.1);
+		for(num_type& x : xs) x = x_dist(generator);
+		xs[0] = std::nan("");
+		xs[2] = std::numeric_limits<num_type>::infinity();
+		xs[4] = -xs[2];
+		for(std::size_t i=0; i<thresholds.size(); ++i) xs[6+2*i] = thresholds[i];
+		
+		std::vector<bin_type> expected(count), out(count);
+		Point<1> point;
+		for(std::size_t n=0; n<count; ++n) {
+			point(1) = xs[2*n];
+			expected[n] = fern1.query(point);
+			EXPECT_EQ(expected[n], flat.query(point));
+		}
+		for(kernel_type kernel : {scalar_kernel, sse4_kernel, avx2_kernel}) {
+			std::fill(out.begin(), out.end(), num_bins);
+			flat.query_batch({{xs.data()}}, 2, count, out.data(), 3, kernel);
+			EXPECT_EQ(expected, out);
+		}
+		std::fill(out.begin(), out.end(), num_bins);
+		flat.query_batch(xs.data(), count, out.data());
+		for(std::size_t n=0; n<count; ++n) {
+			point(1) = xs[n];
+			EXPECT_EQ(fern1.query(point), out[n]);
+		}
+		
+		//a lone leaf's worth of bins needs no thresholds at all
+		Fern<1> plain(line, num_bins);
+		ThresholdFern single(plain);
+		EXPECT_EQ(0u, single.size());
+		EXPECT_EQ(0, single.query(0.5));
+	}
+	
+	TEST(DeepTreeTest, Spine) {
+		//a million forks in one chain, grown by splicing the tree into its own 
+		//deepest leaf; every walk over it has to work without recursing
+		using namespace clau;
+		Region<1> region;
+		region(1) = Interval(0.0, 1.0);
+		Fern<1> fern(region, 3);
+		std::string printed;
+		for(int round=0; round<20; ++round) {
+			Fern<1> copy(fern);
+			auto deepest = fern.begin();
+			while( !deepest.is_leaf() ) deepest.right();
+			ASSERT_TRUE( deepest.splice(copy.begin()) );
+			if(round == 9) {
+				std::stringstream out;
+				out << fern;
+				printed = out.str();
+			}
+		}
+		const std::size_t forks = 1 << 20;
+		ASSERT_EQ(2*forks + 1, fern.get_num_nodes());
+		EXPECT_EQ(2*1024+1 + 4u, std::count(printed.begin(), printed.end(), '\n'));
+		EXPECT_NE(std::string::npos, printed.find( std::string(4*1024, ' ') + "{B0}" ));
+		
+		auto bottom = fern.begin();
+		while( !bottom.is_leaf() ) bottom.right();
+		ASSERT_TRUE( bottom.set_leaf_bin(2) );
+		std::size_t leaves = 0;
+		for(auto& leaf : fern.leaves()) leaves += leaf.bin < 3;
+		EXPECT_EQ(forks + 1, leaves);
+		Point<1> low, high;
+		low(1) = 0.0;
+		high(1) = 1.0; //every boundary is below it, down to the last one
+		EXPECT_EQ(0, fern.query(low));
+		EXPECT_EQ(2, fern.query(high));
+		EXPECT_EQ(2, CompiledFern<1>(fern).query(high));
+		
+		//a copy changed at the bottom claims the whole spine for itself
+		Fern<1> changed(fern);
+		auto other = changed.begin();
+		while( !other.is_leaf() ) other.right();
+		ASSERT_TRUE( other.set_leaf_bin(1) );
+		EXPECT_EQ(1, changed.query(high));
+		EXPECT_EQ(2, fern.query(high));
+		
+		region(1) = Interval(-1.0, 1.0);
+		fern.set_bounds(region);
+		low(1) = -1.0;
+		EXPECT_EQ(0, fern.query(low));
+		EXPECT_EQ(2, fern.query(high));
+		
+		//copies and the binary format round-trip; memory stays per fork
+		Fern<1> loaded;
+		std::string data = fern.save_binary();
+		ASSERT_TRUE( loaded.load_binary(data.data(), data.size()) );
+		EXPECT_EQ(2, loaded.query(high));
+		fern.compact();
+		EXPECT_GE(40*forks, fern.footprint());
+	}
+	
+	TEST_F(FernTest, Leaves) {
+		using namespace clau;
+		ExpandFern();
+		std::vector<bin_type> bins;
+		std::vector< Region<2> > regions;
+		for(auto& leaf : fern.leaves()) {
+			bins.push_back(leaf.bin);
+			regions.push_back(leaf.region);
+		}
+		EXPECT_EQ(std::vector<bin_type>({0, 1, 0, 2, 0}), bins);
+		ASSERT_EQ(fern.get_num_leaves(), regions.size());
+		//neighbours meet exactly at a stored boundary, and undone narrowing 
+		//leaves no trace
+		EXPECT_EQ(regions[0](2).upper, regions[1](2).lower);
+		EXPECT_EQ(regions[1](2).upper, regions[2](2).lower);
+		EXPECT_EQ(regions[0](1).upper, regions[3](1).lower);
+		EXPECT_EQ(span2, regions[3](2));
+		EXPECT_EQ(span1.upper, regions[4](1).upper);
+		
+		fern.set_node_type_chance(0.85);
+		for(int i=0; i<300; ++i) fern.mutate();
+		double volume = 0.0;
+		std::size_t count = 0;
+		for(auto leaf = fern.leaves().begin(); leaf != fern.leaves().end(); ++leaf, ++count) {
+			Point<2> center;
+			for(int i=1; i<=2; ++i) 
+				center(i) = 0.5*(leaf->region(i).lower + leaf->region(i).upper);
+			EXPECT_EQ(leaf->bin, fern.query(center));
+			volume += leaf->region(1).span()*leaf->region(2).span();
+		}
+		EXPECT_EQ(fern.get_num_leaves(), count);
+		EXPECT_NEAR(span1.span()*span2.span(), volume, 1e-4);
+	}
+	
+	TEST_F(FernTest, Rasterizing) {
+		using namespace clau;
+		fern.set_node_type_chance(0.85);
+		fern.randomize(300);
+		//a window past the Fern's region, with tiles cut short at both edges
+		Region<2> window;
+		window(1) = Interval(-0.1, 1.1);
+		window(2) = Interval(1.9, 3.7);
+		const std::size_t width = 301, height = 517;
+		std::vector<bin_type> grid(width*height, num_bins);
+		for(unsigned int threads : {1u, 3u}) {
+			fern.rasterize(window, width, height, grid.data(), threads);
+			std::size_t wrong = 0;
+			Point<2> center;
+			for(std::size_t y=0; y<height; ++y) 
+				for(std::size_t x=0; x<width; ++x) {
+					center(1) = window(1).lower + (x + 0.5)*(double(window(1).upper) - window(1).lower)/width;
+					center(2) = window(2).lower + (y + 0.5)*(double(window(2).upper) - window(2).lower)/height;
+					wrong += grid[y*width + x] != fern.query(center);
+				}
+			EXPECT_EQ(0u, wrong);
+		}
+		
+		//a 1D Fern repeats one row
+		Region<1> line;
+		line(1) = span1;
+		Fern<1> fern1(line, num_bins);
+		fern1.set_node_type_chance(0.85);
+		fern1.randomize(200);
+		std::vector<bin_type> strip(width*3);
+		fern1.rasterize(line, width, 3, strip.data(), 2);
+		Point<1> point1;
+		for(std::size_t x=0; x<width; ++x) {
+			point1(1) = line(1).lower + (x + 0.5)*(double(line(1).upper) - line(1).lower)/width;
+			EXPECT_EQ(fern1.query(point1), strip[x]);
+			EXPECT_EQ(strip[x], strip[2*width + x]);
+		}
+	}
+	
+	TEST_F(FernTest, Grid) {
+		using namespace clau;
+		ExpandFern();
+		fern.set_node_type_chance(0.85);
+		fern.randomize(300);
+		Fern<2> plain(fern);
+		EXPECT_EQ(0u, plain.get_grid_resolution());
+		EXPECT_TRUE( fern.set_grid(64) );
+		EXPECT_EQ(64u, fern.get_grid_resolution());
+		EXPECT_TRUE( fern.set_grid(1000, 4*100*100) );
+		EXPECT_EQ(100u, fern.get_grid_resolution()); //capped
+		EXPECT_TRUE( fern.set_grid(37) );
+		EXPECT_FALSE( Fern<4>().set_grid(8) );
+		
+		//scattered points past the region, plus leaf corners, which sit on 
+		//boundaries and so test the slack around every cell
+		std::mt19937 generator(5);
+		std::uniform_real_distribution<num_type> x_dist(-0.1, 1.1), y_dist(1.9, 4.1);
+		auto check = [&]() {
+			std::vector<num_type> points;
+			for(int n=0; n<20000; ++n) {
+				points.push_back( x_dist(generator) );
+				points.push_back( y_dist(generator) );
+			}
+			for(auto& leaf : fern.leaves()) {
+				points.push_back( leaf.region(1).lower );
+				points.push_back( leaf.region(2).lower );
+				points.push_back( leaf.region(1).upper );
+				points.push_back( leaf.region(2).upper );
+			}
+			points.push_back( std::nan("") );
+			points.push_back( 3.0 );
+			const std::size_t count = points.size()/2;
+			std::vector<bin_type> expected(count), out(count);
+			Point<2> point;
+			std::size_t wrong = 0;
+			for(std::size_t n=0; n<count; ++n) {
+				point(1) = points[2*n];
+				point(2) = points[2*n+1];
+				expected[n] = plain.query(point);
+				wrong += fern.query(point) != expected[n];
+			}
+			EXPECT_EQ(0u, wrong);
+			fern.query_batch(points.data(), count, out.data(), 3);
+			EXPECT_EQ(expected, out);
+		};
+		check();
+		
+		//rebuilt after changes, whether through handles or to the region
+		for(int i=0; i<50; ++i) {
+			fern.mutate();
+			plain = fern;
+			plain.set_grid(0);
+			check();
+		}
+		Region<2> wider;
+		wider(1) = Interval(-5.0, 2.0);
+		wider(2) = Interval(1.0, 4.0);
+		fern.set_bounds(wider);
+		plain.set_bounds(wider);
+		check();
+		
+		//concurrent first queries after a change all wait for one build
+		fern.mutate();
+		plain = fern;
+		plain.set_grid(0);
+		std::vector<std::thread> workers;
+		std::atomic<int> wrong(0);
+		for(int t=0; t<4; ++t) 
+			workers.push_back( std::thread([&, t]() {
+				Point<2> point;
+				for(int n=0; n<2000; ++n) {
+					point(1) = -5.0 + 7.0*((n*7 + t) % 2000)/2000.0;
+					point(2) = 1.0 + 3.0*((n*13 + t) % 2000)/2000.0;
+					if(fern.query(point) != plain.query(point)) ++wrong;
+				}
+			}) );
+		for(auto& worker : workers) worker.join();
+		EXPECT_EQ(0, wrong.load());
+		
+		//three dimensions
+		Region<3> cube;
+		cube.set_uniform( Interval(-1.0, 1.0) );
+		Fern<3> fern3(cube, 4), plain3;
+		fern3.set_node_type_chance(0.85);
+		fern3.randomize(300);
+		plain3 = fern3;
+		EXPECT_TRUE( fern3.set_grid(16) );
+		Point<3> point3;
+		std::uniform_real_distribution<num_type> cube_dist(-1.1, 1.1);
+		for(int n=0; n<20000; ++n) {
+			for(int i=1; i<=3; ++i) point3(i) = cube_dist(generator);
+			ASSERT_EQ(plain3.query(point3), fern3.query(point3));
+		}
+	}
+	
+	TEST_F(FernTest, BinaryFormat) {
+		using namespace clau;
+		ExpandFern();
+		fern.set_node_type_chance(0.85);
+		fern.set_mutation_type_chance(0.1, 0.25);
+		for(int i=0; i<200; ++i) fern.mutate();
+		
+		std::string data = fern.save_binary();
+		Fern<2> loaded;
+		ASSERT_TRUE( loaded.load_binary(data.data(), data.size()) );
+		EXPECT_TRUE( CheckEqual(fern, loaded) );
+		EXPECT_EQ(fern.get_num_nodes(), loaded.get_num_nodes());
+		EXPECT_EQ(fern.get_node_type_chance(), loaded.get_node_type_chance());
+		EXPECT_EQ(fern.get_mutation_type_chance_fork(), loaded.get_mutation_type_chance_fork());
+		EXPECT_EQ(fern.get_mutation_type_chance_leaf(), loaded.get_mutation_type_chance_leaf());
+		EXPECT_EQ(data, loaded.save_binary());
+		//three bins and two dimensions pack a node into three bits
+		EXPECT_GE(46 + (3*fern.get_num_nodes()+7)/8, data.size());
+		
+		//Ferns saved back to back load back in turn
+		std::stringstream stream;
+		Fern<2> small(region, num_bins);
+		fern.save_binary(stream);
+		small.save_binary(stream);
+		Fern<2> first, second;
+		EXPECT_TRUE( first.load_binary(stream) );
+		EXPECT_TRUE( second.load_binary(stream) );
+		EXPECT_FALSE( Fern<2>().load_binary(stream) );
+		EXPECT_TRUE( CheckEqual(fern, first) );
+		EXPECT_TRUE( CheckEqual(small, second) );
+		
+		//bad input is refused and changes nothing
+		std::string before = loaded.save_binary();
+		for(std::size_t size : {std::size_t(0), std::size_t(10), data.size()-1}) 
+			EXPECT_FALSE( loaded.load_binary(data.data(), size) );
+		std::string corrupt = data;
+		corrupt[4] = 2; //version
+		EXPECT_FALSE( loaded.load_binary(corrupt.data(), corrupt.size()) );
+		corrupt = data;
+		corrupt[38] ^= 2; //node count, no longer matching the payload
+		EXPECT_FALSE( loaded.load_binary(corrupt.data(), corrupt.size()) );
+		EXPECT_FALSE( Fern<1>().load_binary(data.data(), data.size()) );
+		EXPECT_EQ(before, loaded.save_binary());
+		
+		//a truncated stream claiming a huge payload fails without allocating it
+		std::string huge = data.substr(0, 46);
+		for(int i=38; i<46; ++i) huge[i] = char(0xFF); //node count and payload length
+		std::stringstream truncated(huge);
+		EXPECT_FALSE( loaded.load_binary(truncated) );
+		huge[45] = 0x0F; //too long for the node count
+		for(int i=38; i<42; ++i) huge[i] = 0;
+		huge[38] = 9;
+		std::stringstream mismatched(huge + data.substr(46));
+		EXPECT_FALSE( loaded.load_binary(mismatched) );
+		EXPECT_EQ(before, loaded.save_binary());
+	}
+	
+	TEST_F(FernTest, Mapping) {
+		using namespace clau;
+		ExpandFern();
+		for(int i=0; i<200; ++i) fern.mutate();
+		const std::string path = "mapped_fern_test.bin";
+		ASSERT_TRUE( MappedFern<2>::write(fern, path) );
+		
+		MappedFern<2> mapped(path);
+		ASSERT_TRUE( mapped.is_open() );
+		EXPECT_TRUE( mapped.verify() );
+		CompiledFern<2> compiled(fern);
+		EXPECT_EQ(compiled.size(), mapped.size());
+		EXPECT_EQ(fern.get_region(), mapped.get_region());
+		EXPECT_EQ(fern.get_num_bins(), mapped.get_num_bins());
+		EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(mapped.data()) % 64);
+		
+		const std::size_t count = 5003;
+		std::vector<num_type> aos(2*count);
+		std::mt19937 generator(5);
+		std::uniform_real_distribution<num_type> x_dist(-0.1, 1.1), y_dist(1.9, 4.1);
+		for(std::size_t n=0; n<count; ++n) {
+			aos[2*n] = x_dist(generator);
+			aos[2*n+1] = y_dist(generator);
+		}
+		std::vector<bin_type> expected(count), bins(count);
+		compiled.query_batch(aos.data(), count, expected.data());
+		mapped.query_batch(aos.data(), count, bins.data(), 3);
+		EXPECT_EQ(expected, bins);
+		Point<2> point;
+		point(1) = aos[0];
+		point(2) = aos[1];
+		EXPECT_EQ(expected[0], mapped.query(point));
+		
+		//moving hands over the mapping
+		MappedFern<2> moved( std::move(mapped) );
+		EXPECT_FALSE( mapped.is_open() );
+		EXPECT_TRUE( moved.is_open() );
+		EXPECT_EQ(expected[0], moved.query(point));
+		
+		//the wrong dimension, a truncated file and a missing one are refused
+		EXPECT_FALSE( MappedFern<1>(path).is_open() );
+		std::ifstream in(path.c_str(), std::ios::binary);
+		std::string contents( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
+		in.close();
+		{
+			std::ofstream out(path.c_str(), std::ios::binary);
+			out.write(contents.data(), contents.size()-1);
+		}
+		EXPECT_FALSE( MappedFern<2>(path).is_open() );
+		//a child link pointing backwards opens, but doesn't verify
+		CompiledFern<2>::Record record;
+		std::memcpy(&record, contents.data() + 64, sizeof(record));
+		record.child[0] = 0;
+		std::memcpy(&contents[64], &record, sizeof(record));
+		{
+			std::ofstream out(path.c_str(), std::ios::binary);
+			out.write(contents.data(), contents.size());
+		}
+		MappedFern<2> looped(path);
+		EXPECT_TRUE( looped.is_open() );
+		EXPECT_FALSE( looped.verify() );
+		looped.close();
+		//a record count that only matches the file size modulo 2^64
+		std::uint64_t records;
+		std::memcpy(&records, contents.data() + 24, 8);
+		records += std::uint64_t(1) << 60;
+		std::memcpy(&contents[24], &records, 8);
+		{
+			std::ofstream out(path.c_str(), std::ios::binary);
+			out.write(contents.data(), contents.size());
+		}
+		EXPECT_FALSE( MappedFern<2>(path).is_open() );
+		moved.close();
+		std::remove( path.c_str() );
+		EXPECT_FALSE( MappedFern<2>(path).is_open() );
+	}
+	
+	TEST_F(FernTest, Scoring) {
+		using namespace clau;
+		ExpandFern();
+		const std::size_t count = 20011;
+		std::vector<num_type> aos(2*count), weights(count);
+		std::vector<bin_type> labels(count);
+		std::mt19937 generator(11);
+		std::uniform_real_distribution<num_type> x_dist(-0.1, 1.1), y_dist(1.9, 4.1), w_dist(0, 2);
+		std::uniform_int_distribution<bin_type> label_dist(0, 3); //3 is past the last bin
+		
+		//the same sums, point by point
+		std::vector<std::size_t> matrix(9, 0);
+		std::size_t correct = 0;
+		double correct_weight = 0.0, total_weight = 0.0;
+		Point<2> point;
+		for(std::size_t n=0; n<count; ++n) {
+			point(1) = aos[2*n] = x_dist(generator);
+			point(2) = aos[2*n+1] = y_dist(generator);
+			labels[n] = label_dist(generator);
+			weights[n] = w_dist(generator);
+			bin_type bin = fern.query(point);
+			total_weight += weights[n];
+			if(bin == labels[n]) {
+				++correct;
+				correct_weight += weights[n];
+			}
+			if(labels[n] < 3) ++matrix[labels[n]*3 + bin];
+		}
+		
+		CompiledFern<2> compiled(fern);
+		std::array<const num_type*, 2> bases = {{aos.data(), aos.data()+1}};
+		for(unsigned int threads : {1u, 4u}) {
+			EXPECT_DOUBLE_EQ(double(correct)/count, 
+				accuracy(fern, aos.data(), count, labels.data(), threads));
+			EXPECT_DOUBLE_EQ(double(correct)/count, 
+				accuracy(compiled, bases, 2, count, labels.data(), threads));
+			EXPECT_NEAR(correct_weight/total_weight, weighted_accuracy(fern, aos.data(), 
+				count, labels.data(), weights.data(), threads), 1e-9);
+			EXPECT_EQ(matrix, confusion_matrix(fern, aos.data(), count, labels.data(), threads));
+			EXPECT_EQ(matrix, confusion_matrix(compiled, bases, 2, count, 
+							   labels.data(), threads));
+		}
+		EXPECT_EQ(0.0, accuracy(fern, aos.data(), 0, labels.data()));
+	}
+	
+	TEST(PopulationTest, Selection) {
+		using namespace clau;
+		//founders are told apart by their number of bins, which is also their fitness
+		std::vector< Fern<1> > founders;
+		for(bin_type bins=1; bins<=4; ++bins) 
+			for(int i=0; i<1000; ++i) founders.push_back( Fern<1>(bins) );
+		auto fitness = [](const Fern<1>& fern) { return double(fern.get_num_bins()); };
+		
+		Population<1> population(founders, fitness);
+		EXPECT_FALSE( population.set_mutation_rate(1.5) );
+		EXPECT_FALSE( population.set_elites(4000) );
+		EXPECT_TRUE( population.set_elites(3999) );
+		EXPECT_EQ(3999u, population.get_elites());
+		EXPECT_FALSE( population.set_tournament(0) );
+		EXPECT_EQ(roulette_selection, population.get_selection());
+		population.set_elites(0);
+		population.set_mutation_rate(0.0);
+		population.set_crossover_rate(0.0);
+		population.seed(2012);
+		
+		//roulette draws bins k with chance k/10
+		population.breed();
+		std::vector<int> counts(5, 0);
+		for(std::size_t i=0; i<population.size(); ++i) 
+			++counts[ population[i].get_num_bins() ];
+		for(int bins=1; bins<=4; ++bins) 
+			EXPECT_NEAR(400.0*bins, counts[bins], 120.0);
+		
+		//the better of two uniform draws has bins k with chance (2k-1)/16
+		Population<1> tournament(founders, fitness);
+		tournament.set_elites(0);
+		tournament.set_mutation_rate(0.0);
+		tournament.set_crossover_rate(0.0);
+		EXPECT_TRUE( tournament.set_tournament(2) );
+		tournament.seed(2013);
+		tournament.breed();
+		counts.assign(5, 0);
+		for(std::size_t i=0; i<tournament.size(); ++i) 
+			++counts[ tournament[i].get_num_bins() ];
+		for(int bins=1; bins<=4; ++bins) 
+			EXPECT_NEAR(250.0*(2*bins-1), counts[bins], 120.0);
+		EXPECT_EQ(1u, tournament.get_generation());
+	}
+	
+	TEST(PopulationTest, Evolving) {
+		using namespace clau;
+		//the classification problem from demo/classify_fern.py, on fixed data
+		std::vector< Point<1> > points(200);
+		for(std::size_t n=0; n<points.size(); ++n) points[n](1) = -3.0 + 6.0*n/points.size();
+		auto fitness = [&points](const Fern<1>& fern) { 
+			double correct = 0.0;
+			for(auto& point : points) correct += fern.query(point) == (point(1) > 1.0 ? 0 : 1);
+			return correct;
+		};
+		Region<1> region;
+		region.set_uniform( Interval(-3.0, 3.0) );
+		
+		std::vector< std::vector<double> > history(2);
+		for(auto& best : history) {
+			Population<1> population(Fern<1>(region, 2), 50, fitness);
+			population.seed(2012);
+			population.randomize(15);
+			for(int i=0; i<30; ++i) {
+				population.run(1);
+				best.push_back( population.get_fitness()[population.best()] );
+			}
+			EXPECT_EQ(30u, population.get_generation());
+		}
+		
+		//elitism never loses the best member, and a seed fixes the whole run
+		for(std::size_t i=1; i<history[0].size(); ++i) 
+			EXPECT_LE(history[0][i-1], history[0][i]);
+		EXPECT_LT(history[0].front(), history[0].back());
+		EXPECT_EQ(history[0], history[1]);
+	}
+	
+	TEST(PopulationTest, Threading) {
+		using namespace clau;
+		Region<2> region;
+		region.set_uniform( Interval(0.0, 1.0) );
+		Population<2> population(Fern<2>(region, 3), 40, 
+			[](const Fern<2>& fern) { return double(fern.get_num_nodes()); });
+		population.randomize(20);
+		population.evaluate();
+		std::vector<double> serial = population.get_fitness();
+		
+		//members share most of their nodes, and are read from every thread at once
+		population.set_threads(4);
+		population.evaluate();
+		EXPECT_EQ(serial, population.get_fitness());
+		EXPECT_EQ(population.size(), population.get_timings().size());
+		for(double seconds : population.get_timings()) EXPECT_LE(0.0, seconds);
+		population.run(5);
+		EXPECT_EQ(5u, population.get_generation());
+	}
+	
+	struct BangBang { //optimal controllers from the demos, as Fern stand-ins
+		clau::bin_type query(const clau::Point<1>& point) const { 
+			return point(1) > 0 ? 1 : point(1) < 0 ? 2 : 0; 
+		}
+		clau::bin_type query(const clau::Point<2>& point) const {
+			double theta = point(1), h = point(2);
+			double path = -0.5*h*std::fabs(h)/(100.0*0.5);
+			return theta > path ? 1 : theta < path ? 2 : h > 0 ? 1 : h < 0 ? 2 : 0;
+		}
+	};
+	
+	TEST(PopulationTest, Saving) {
+		using namespace clau;
+		Region<2> region;
+		region(1) = Interval(-1.0, 1.0);
+		region(2) = Interval(0.0, 4.0);
+		Fern<2> ancestor(region, 3);
+		Population<2> population(ancestor, 40, [](const Fern<2>& fern) { 
+			return double( fern.get_num_nodes() ); });
+		population.seed(3);
+		population.randomize(30);
+		population.run(2); //members share nodes
+		const std::string path = "population_test.bin";
+		const auto& members = population.get_members();
+		auto fitness = population.get_fitness();
+		fitness[1] = -0.25;
+		ASSERT_TRUE( save_population(path, members, fitness, 3) );
+		EXPECT_FALSE( save_population(path + "x", members, std::vector<double>(3)) );
+		
+		PopulationFile<2> file(path);
+		ASSERT_TRUE( file.is_open() );
+		ASSERT_EQ(members.size(), file.size());
+		EXPECT_EQ(fitness, file.get_fitness());
+		Fern<2> one;
+		ASSERT_TRUE( file.load(17, one) );
+		EXPECT_EQ(members[17].save_binary(), one.save_binary());
+		std::vector< Fern<2> > loaded(5, one);
+		ASSERT_TRUE( file.load_all(loaded, 3) );
+		ASSERT_EQ(members.size(), loaded.size());
+		for(std::size_t i=0; i<members.size(); ++i) 
+			EXPECT_EQ(members[i].save_binary(), loaded[i].save_binary());
+		
+		//the wrong dimension, a cut table and a cut Fern are refused
+		EXPECT_FALSE( PopulationFile<1>(path).is_open() );
+		std::ifstream in(path.c_str(), std::ios::binary);
+		std::string contents( (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>() );
+		in.close();
+		for(std::size_t size : {std::size_t(100), contents.size()-1}) {
+			std::ofstream out(path.c_str(), std::ios::binary);
+			out.write(contents.data(), size);
+			out.close();
+			EXPECT_FALSE( PopulationFile<2>(path).is_open() );
+		}
+		file.close();
+		std::remove( path.c_str() );
+		
+		EXPECT_TRUE( save_population(path, std::vector< Fern<2> >(), std::vector<double>()) );
+		EXPECT_TRUE( PopulationFile<2>(path).is_open() );
+		EXPECT_EQ(0u, PopulationFile<2>(path).size());
+		std::remove( path.c_str() );
+	}
+	
+	TEST(SimulationTest, Switching) {
+		using namespace clau;
+		SimulationSettings settings;
+		for(bool adaptive : {true, false}) {
+			settings.adaptive = adaptive;
+			
+			//decelerates from 5 at 0.5 per second until it reaches the dead zone
+			Trajectory<1> run = simulate(velocity_plant(), BangBang(), {{5.0}}, settings);
+			ASSERT_TRUE(run.finished);
+			EXPECT_EQ(run.times.size(), run.modes.size());
+			EXPECT_EQ(1, run.modes.front());
+			EXPECT_EQ(0, run.modes.back());
+			EXPECT_NEAR(100.0, run.times.back(), 1e-9);
+			double switched = 0.0;
+			for(std::size_t n=0; n<run.modes.size(); ++n) 
+				if(run.modes[n] == 0) { switched = run.times[n]; break; }
+			EXPECT_NEAR((5.0 - settings.dead_zone)/0.5, switched, settings.event_tolerance);
+			EXPECT_GT(settings.dead_zone, std::fabs(run.states.back()[0]));
+			EXPECT_NEAR(25.0 + 90*settings.dead_zone, absolute_error(run, 100.0), 0.05);
+			
+			//the satellite comes to rest along the switching curve
+			Trajectory<2> orbit = simulate(satellite_plant(), BangBang(), {{1.0, 1.0}}, settings);
+			ASSERT_TRUE(orbit.finished);
+			EXPECT_GT(settings.dead_zone, std::fabs(orbit.states.back()[0]) + 
+						      std::fabs(orbit.states.back()[1]));
+		}
+	}
+	
+	TEST(SimulationTest, Budget) {
+		using namespace clau;
+		SimulationSettings settings;
+		settings.step_budget = 5;
+		Trajectory<1> run = simulate(velocity_plant(), BangBang(), {{5.0}}, settings);
+		EXPECT_FALSE(run.finished);
+		EXPECT_EQ(5u, run.steps);
+		
+		//an unfinished run is held at penalty times its last state until t_final
+		double held = 0.5*(100.0 - run.times.back())*1001*std::fabs(run.states.back()[0]);
+		double flown = absolute_error(run, 100.0, 0.0) - 
+			       0.5*(100.0 - run.times.back())*std::fabs(run.states.back()[0]);
+		EXPECT_NEAR(flown + held, absolute_error(run, 100.0), 1e-9);
+		
+		//a Fern controller and its compiled snapshot fly the same course
+		Region<2> region;
+		region(1) = Interval(-M_PI, M_PI);
+		region(2) = Interval(-2.0, 2.0);
+		Fern<2> fern(region, 3);
+		fern.seed(5);
+		fern.randomize(40);
+		settings.step_budget = 2000;
+		std::vector< std::array<double, 2> > starts = {{{1.0, 1.0}}, {{-2.0, 0.5}}};
+		EXPECT_EQ(tracking_error(satellite_plant(), fern, starts, settings), 
+			  tracking_error(satellite_plant(), CompiledFern<2>(fern), starts, settings));
+	}
+	
 	/*
 	TEST_F(FernTest, Pickling) {
 		using namespace clau;